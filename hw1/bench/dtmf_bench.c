@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "const.h"
+#include "options.h"
+#include "detect.h"
+#include "goertzel_bank.h"
+
+/*
+ * Throughput benchmark for the DTMF pipeline.
+ *
+ * A corpus is synthesized with dtmf_generate from a schedule of tones of the
+ * requested length and density, optionally mixed with noise through the -n/-l
+ * path.  dtmf_detect is then timed end to end on the corpus, followed by each
+ * stage of detection in isolation: header parsing, decoding of the samples,
+ * the Goertzel filters, and the decision logic, which is also timed on random
+ * strengths that defeat branch prediction.  Each measurement is repeated
+ * and the fastest run is reported, to filter out interference.
+ */
+
+#define BENCH_USAGE \
+"USAGE: %s [-t SECONDS] [-p PERCENT] [-m MSEC] [-n NOISE_FILE] [-l LEVEL] [-b BLOCKSIZE]\n" \
+"       [-j JOBS] [-r REPEAT]\n" \
+"   -t SECONDS    length of the synthesized corpus (default 60)\n" \
+"   -p PERCENT    percentage of the corpus occupied by tones (default 50)\n" \
+"   -m MSEC       duration of each tone (default 100)\n" \
+"   -n NOISE_FILE audio file mixed with the tones (default none)\n" \
+"   -l LEVEL      noise level in dB relative to the tones (default 0)\n" \
+"   -b BLOCKSIZE  detection block size (default 100)\n" \
+"   -j JOBS       threads used by dtmf_detect (default 1)\n" \
+"   -r REPEAT     number of times each measurement is repeated (default 5)\n"
+
+#define BENCH_HEADER_CALLS 100000   // Calls timed in the header stage.
+#define BENCH_DECIDE_BLOCKS 1000000  // Random strength vectors in the decision micro-benchmark.
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_report(const char *stage, double secs, double count, const char *unit) {
+    printf("%-10s %10.3f ms %12.2f ns/%-6s %14.0f %s/sec\n",
+           stage, secs * 1e3, secs * 1e9 / count, unit, count / secs, unit);
+}
+
+/*
+ * bench_schedule - write an event list of tones of tone_ms milliseconds,
+ * spaced so that they occupy the given percentage of the corpus.
+ */
+static int bench_schedule(FILE *out, uint32_t length, int percent, int tone_ms) {
+    const char *symbols = "0123456789ABCD*#";
+    uint32_t tone = tone_ms * (AUDIO_FRAME_RATE / 1000);
+    uint32_t period = percent > 0 ? (uint64_t)tone * 100 / percent : length;
+    int events = 0;
+    for (uint32_t start = 0; percent > 0 && start + tone <= length; start += period) {
+        fprintf(out, "%u\t%u\t%c\n", start, start + tone, symbols[events % 16]);
+        events++;
+    }
+    return events;
+}
+
+int main(int argc, char **argv) {
+    int seconds = 60, percent = 50, tone_ms = 100, repeat = 5, opt;
+    noise_file = NULL;
+    noise_level = 0;
+    block_size = 100;
+    num_jobs = 1;
+    batch_count = 0;
+    stream_mode = 0;
+    telemetry_file = NULL;
+    while ((opt = getopt(argc, argv, "t:p:m:n:l:b:j:r:")) != -1) {
+        switch (opt) {
+        case 't': seconds = atoi(optarg); break;
+        case 'p': percent = atoi(optarg); break;
+        case 'm': tone_ms = atoi(optarg); break;
+        case 'n': noise_file = optarg; break;
+        case 'l': noise_level = atoi(optarg); break;
+        case 'b': block_size = atoi(optarg); break;
+        case 'j': num_jobs = atoi(optarg); break;
+        case 'r': repeat = atoi(optarg); break;
+        default:
+            fprintf(stderr, BENCH_USAGE, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (seconds < 1 || seconds > 100000 || percent < 0 || percent > 100 || tone_ms < 1
+        || block_size < 10 || block_size > 1000 || num_jobs < 1 || num_jobs > MAX_DETECT_JOBS
+        || repeat < 1) {
+        fprintf(stderr, BENCH_USAGE, argv[0]);
+        return EXIT_FAILURE;
+    }
+    uint32_t length = (uint32_t)seconds * AUDIO_FRAME_RATE;
+
+    //synthesize the corpus
+    FILE *events = tmpfile();
+    FILE *audio = tmpfile();
+    FILE *sink = fopen("/dev/null", "w");
+    if (events == NULL || audio == NULL || sink == NULL) {
+        perror("dtmf_bench");
+        return EXIT_FAILURE;
+    }
+    int count = bench_schedule(events, length, percent, tone_ms);
+    rewind(events);
+    double t = bench_now();
+    if (dtmf_generate(events, audio, length) == EOF || fflush(audio) == EOF) {
+        fprintf(stderr, "dtmf_bench: corpus generation failed\n");
+        return EXIT_FAILURE;
+    }
+    double gen = bench_now() - t;
+    printf("corpus: %u samples (%d s), %d tones of %d ms, %d%% tones, noise %s at %d dB\n",
+           length, seconds, count, tone_ms, percent, noise_file ? noise_file : "(none)", noise_level);
+    printf("detect: block size %d, %d job(s), best of %d\n\n", block_size, num_jobs, repeat);
+    bench_report("generate", gen, length, "sample");
+
+    //end to end
+    double best = 0;
+    for (int r = 0; r < repeat; r++) {
+        rewind(audio);
+        t = bench_now();
+        if (dtmf_detect(audio, sink) == EOF) {
+            fprintf(stderr, "dtmf_bench: detection failed\n");
+            return EXIT_FAILURE;
+        }
+        t = bench_now() - t;
+        best = r == 0 || t < best ? t : best;
+    }
+    bench_report("detect", best, length, "sample");
+    printf("\n");
+
+    //header parsing
+    AUDIO_HEADER header;
+    best = 0;
+    for (int r = 0; r < repeat; r++) {
+        t = bench_now();
+        for (int i = 0; i < BENCH_HEADER_CALLS; i++) {
+            rewind(audio);
+            audio_read_header(audio, &header);
+        }
+        t = bench_now() - t;
+        best = r == 0 || t < best ? t : best;
+    }
+    bench_report("header", best, BENCH_HEADER_CALLS, "call");
+
+    //sample decoding, from the mapped file
+    AUDIO_MAP map;
+    rewind(audio);
+    if (audio_read_header(audio, &header) == EOF || audio_map_samples(audio, &map) == EOF) {
+        fprintf(stderr, "dtmf_bench: cannot map corpus\n");
+        return EXIT_FAILURE;
+    }
+    int16_t *samples = malloc(map.samples * sizeof(int16_t));
+    uint32_t N = block_size;
+    size_t blocks = (map.samples + N - 1) / N;
+    double *strengths = malloc(blocks * NUM_DTMF_FREQS * sizeof(double));
+    if (samples == NULL || strengths == NULL) {
+        perror("dtmf_bench");
+        return EXIT_FAILURE;
+    }
+    best = 0;
+    for (int r = 0; r < repeat; r++) {
+        t = bench_now();
+        for (size_t i = 0; i < map.samples; i++) {
+            samples[i] = audio_decode_sample(map.data + i * AUDIO_BYTES_PER_SAMPLE);
+        }
+        t = bench_now() - t;
+        best = r == 0 || t < best ? t : best;
+    }
+    bench_report("decode", best, map.samples, "sample");
+
+    //Goertzel filters, over the decoded samples
+    GOERTZEL_BANK bank;
+    goertzel_bank_init(&bank, N, dtmf_freqs, NUM_DTMF_FREQS, AUDIO_FRAME_RATE);
+    best = 0;
+    for (int r = 0; r < repeat; r++) {
+        t = bench_now();
+        for (size_t b = 0; b < blocks; b++) {
+            size_t start = b * N;
+            uint32_t n = map.samples - start < N ? map.samples - start : N;
+            goertzel_bank_reset(&bank);
+            goertzel_bank_run(&bank, samples + start, n < N ? n : N - 1);
+            goertzel_bank_strength(&bank, n < N ? 0 : samples[start + N - 1]);
+            for (int j = 0; j < NUM_DTMF_FREQS; j++) {
+                strengths[b * NUM_DTMF_FREQS + j] = bank.y[j];
+            }
+        }
+        t = bench_now() - t;
+        best = r == 0 || t < best ? t : best;
+    }
+    bench_report("goertzel", best, map.samples, "sample");
+
+    //decision logic, over the stored strengths
+    int found = 0;
+    best = 0;
+    for (int r = 0; r < repeat; r++) {
+        found = 0;
+        t = bench_now();
+        for (size_t b = 0; b < blocks; b++) {
+            found += dtmf_decide(strengths + b * NUM_DTMF_FREQS) != 0;
+        }
+        t = bench_now() - t;
+        best = r == 0 || t < best ? t : best;
+    }
+    bench_report("decide", best, blocks, "block");
+
+    //decision logic alone, on strengths with no pattern for a branch predictor
+    double *random = malloc(BENCH_DECIDE_BLOCKS * NUM_DTMF_FREQS * sizeof(double));
+    if (random == NULL) {
+        perror("dtmf_bench");
+        return EXIT_FAILURE;
+    }
+    srand(1);
+    for (size_t b = 0; b < BENCH_DECIDE_BLOCKS; b++) {
+        double *y = random + b * NUM_DTMF_FREQS;
+        double floor = (double)rand() / RAND_MAX * 0.05;
+        for (int j = 0; j < NUM_DTMF_FREQS; j++) {
+            y[j] = floor * rand() / RAND_MAX;
+        }
+        y[rand() % 4] = (double)rand() / RAND_MAX * 0.3;
+        y[4 + rand() % 4] = (double)rand() / RAND_MAX * 0.3;
+    }
+    int accepted = 0;
+    best = 0;
+    for (int r = 0; r < repeat; r++) {
+        accepted = 0;
+        t = bench_now();
+        for (size_t b = 0; b < BENCH_DECIDE_BLOCKS; b++) {
+            accepted += dtmf_decide(random + b * NUM_DTMF_FREQS) != 0;
+        }
+        t = bench_now() - t;
+        best = r == 0 || t < best ? t : best;
+    }
+    bench_report("decide-rnd", best, BENCH_DECIDE_BLOCKS, "block");
+    printf("\n%zu blocks, %d with a tone; %d of %d random vectors accepted\n",
+           blocks, found, accepted, BENCH_DECIDE_BLOCKS);
+    free(random);
+
+    audio_unmap_samples(&map);
+    free(samples);
+    free(strengths);
+    fclose(events);
+    fclose(audio);
+    fclose(sink);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+#ifndef AUDIO_IO_H
+#define AUDIO_IO_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+
+/*
+ * Bulk access to audio sample data, as a complement to the one-sample-at-a-time
+ * audio_read_sample and audio_write_sample of audio.h: block transfers through
+ * a stream, and a memory mapping of the sample data of a regular file.
+ */
+
+/*
+ * Maximum number of interleaved channels accepted in an audio file on input.
+ * The files we create are monaural, with AUDIO_CHANNELS channel.
+ */
+#define AUDIO_MAX_CHANNELS 32
+
+/*
+ * Sample buffer for use in bulk reading and writing of audio data.
+ * It is large enough to hold one detection block of the maximum size.
+ */
+#define SAMPLE_BUF_SIZE 1000
+extern int16_t sample_buf[SAMPLE_BUF_SIZE];
+
+/**
+ * Read a block of two-byte audio samples from an input stream.
+ * The big-endian sample data is read with a single bulk transfer directly into
+ * the caller's array and then decoded in place, so that the cost per sample is
+ * independent of the per-call overhead of the underlying stream.
+ *
+ *   @param in  Input stream from which samples are to be read.
+ *   @param samples  Array into which to store the decoded sample values.
+ *   @param n  Maximum number of samples to be read.
+ *   @return the number of complete samples read, which is less than n only
+ *   if EOF or an error was encountered.
+ */
+size_t audio_read_samples(FILE *in, int16_t *samples, size_t n);
+
+/**
+ * Write a block of two-byte audio samples to an output stream.
+ * The samples are encoded in big-endian byte order into a local staging buffer,
+ * which is written to the stream in large chunks.
+ *
+ *   @param out  Output stream to which samples are to be written.
+ *   @param samples  Array of samples to be written.
+ *   @param n  Number of samples to be written.
+ *   @return the number of samples written, which is less than n only
+ *   if an error occurred.
+ */
+size_t audio_write_samples(FILE *out, const int16_t *samples, size_t n);
+
+/**
+ * Write a run of zero samples to an output stream.
+ * If the stream is a regular file that ends at the current position, and the
+ * run is long, the file is extended by seeking over the run instead, so that
+ * the file system can leave a hole, which reads as zeros, rather than storing
+ * the zeros.  Otherwise zero bytes are written in large blocks.
+ *
+ *   @param out  Output stream to which samples are to be written.
+ *   @param n  Number of zero samples to be written.
+ *   @return the number of samples written, which is less than n only
+ *   if an error occurred.
+ */
+size_t audio_write_silence(FILE *out, size_t n);
+
+/**
+ * Decode one two-byte big-endian sample from raw audio data.
+ *
+ *   @param bytes  Pointer to the most significant byte of the sample.
+ *   @return the decoded sample value.
+ */
+static inline int16_t audio_decode_sample(const uint8_t *bytes) {
+    return (int16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+/*
+ * Read-only memory mapping of the sample data of an audio file.
+ */
+typedef struct audio_map {
+    void *base;            // Start of the mapping (the start of the file).
+    size_t length;         // Length of the mapping in bytes.
+    const uint8_t *data;   // First byte of the big-endian sample data.
+    size_t samples;        // Number of complete samples available at data.
+} AUDIO_MAP;
+
+/**
+ * Map the sample data of an audio file into memory.
+ * The stream must refer to a regular file and must already have been positioned
+ * at the start of the sample data by audio_read_header, so that data_offset and
+ * any annotation are honored.  The samples are left in their on-disk big-endian
+ * form and can be decoded directly from the mapping with audio_decode_sample.
+ *
+ *   @param in  Input stream positioned at the first audio sample.
+ *   @param mp  Pointer to the AUDIO_MAP structure that is to receive the mapping.
+ *   @return 0 if the data was mapped, EOF if the stream cannot be mapped
+ *   (for example, because it is a pipe), in which case the caller should fall
+ *   back to reading the stream.
+ */
+int audio_map_samples(FILE *in, AUDIO_MAP *mp);
+
+/**
+ * Release a mapping established by audio_map_samples.
+ *
+ *   @param mp  Pointer to the mapping to be released.
+ */
+void audio_unmap_samples(AUDIO_MAP *mp);
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "audio_io.h"
+#include "goertzel_bank.h"
+#include "tone.h"
+
+/*
+ * Building blocks of DTMF detection, shared by the serial dtmf_detect loop
+ * and the parallel and batch drivers.  Every block is analyzed independently
+ * of its neighbours, so any driver that presents the same blocks to these
+ * functions and writes the results in order produces identical output.
+ *
+ * Audio with several interleaved channels is analyzed in a single pass over
+ * its frames: each block of N frames is analyzed once for every channel, and
+ * the events of the block are written in channel order, each tagged with its
+ * channel number.  Block sizes and event indices count frames, and the filter
+ * coefficients are derived from the sample rate given in the header.
+ *
+ * The drivers detect the families of tones of a TONE_SET (see tone.h), which
+ * share one pass of the filters over each block.  When the set is DTMF alone,
+ * as it is by default, the output is that of plain DTMF detection; otherwise
+ * each event carries the name of its family, after any channel number.
+ */
+
+/*
+ * Maximum number of worker threads for the -j option.
+ */
+#define MAX_DETECT_JOBS 64
+
+/*
+ * Decide which DTMF symbol, if any, is present in a block.
+ *
+ *   @param y  The strengths of the NUM_DTMF_FREQS DTMF frequencies, in the
+ *   order of dtmf_freqs.
+ *   @return  The symbol name from dtmf_symbol_names, or 0 if the strengths do
+ *   not satisfy the level, twist, and row/column dominance criteria.
+ */
+int dtmf_decide(const double *y);
+
+/*
+ * Make the decision of dtmf_decide with the given thresholds, as power ratios
+ * like the constants of const.h, in portable scalar code.  With MINUS_20DB,
+ * FOUR_DB, and SIX_DB, the result is the same as that of dtmf_decide.
+ *
+ *   @param y  The strengths, as for dtmf_decide.
+ *   @param level  Minimum sum of the row and column maxima.
+ *   @param twist  Maximum ratio between the row and column maxima.
+ *   @param dominance  Minimum ratio of a maximum to the rest of its group.
+ *   @return  The symbol name, or 0 if none.
+ */
+int dtmf_decide_limits(const double *y, double level, double twist, double dominance);
+
+/*
+ * Analyze one block of audio with a bank initialized for the DTMF frequencies.
+ * A full block has n == bp->N samples.  A short block (n < bp->N), which can
+ * only occur at the end of the input, is analyzed as its n samples followed by
+ * a final zero sample.
+ *
+ *   @param bp  Bank of filters, initialized for dtmf_freqs.
+ *   @param x  Decoded samples of the block.
+ *   @param n  Number of samples in the block, at most bp->N.
+ *   @return  The symbol detected in the block, or 0 if none.
+ */
+int dtmf_analyze_block(GOERTZEL_BANK *bp, const int16_t *x, uint32_t n);
+
+/*
+ * Same as dtmf_analyze_block, but with the samples in big-endian on-disk form.
+ * The samples of the block are stride samples apart, so that one channel of
+ * interleaved audio can be analyzed in place; x points at its first sample.
+ */
+int dtmf_analyze_block_be(GOERTZEL_BANK *bp, const uint8_t *x, uint32_t n, uint32_t stride);
+
+/*
+ * Analyze one block of audio for every family of a set, in the manner of
+ * dtmf_analyze_block_be.
+ *
+ *   @param bp  Bank of filters, a copy of that of the set.
+ *   @param sp  The set of families.
+ *   @param symbols  Array into which to store the symbol detected for each
+ *   family of the set, or 0 if none.
+ *   @return Nonzero if a symbol was detected for some family.
+ */
+int tone_analyze_block_be(GOERTZEL_BANK *bp, const TONE_SET *sp, const uint8_t *x, uint32_t n,
+                          uint32_t stride, uint8_t *symbols);
+
+/*
+ * Ending index of a block, as reported in a DTMF event.  A short block is
+ * taken to extend one sample beyond the data, to its final zero sample.
+ */
+static inline size_t dtmf_block_end(size_t start, uint32_t n, uint32_t N) {
+    return n == N ? start + N : start + n + 1;
+}
+
+/*
+ * Write one DTMF event in tab-separated format.
+ *
+ *   @param out  Output stream to which the event is to be written.
+ *   @param tag  If not NULL, a field (the name of the audio file) that is
+ *   written before the other fields of the event.
+ *   @param channel  If nonnegative, the channel number, which is written
+ *   after the tag.
+ *   @param family  If not NULL, the name of the family of the tone, which is
+ *   written after the channel number.
+ *   @param start  Starting index of the event.
+ *   @param end  Ending index of the event.
+ *   @param symbol  The DTMF symbol.
+ *   @return 0 if successful, EOF otherwise.
+ */
+int dtmf_write_event(FILE *out, const char *tag, int channel, const char *family, size_t start,
+                     size_t end, int symbol);
+
+/*
+ * Detect DTMF events in one audio stream.
+ * The header is read and validated, and the samples are then analyzed block by
+ * block, through a mapping if the stream is a regular file and by reading the
+ * stream otherwise.
+ *
+ *   @param audio_in  Input stream from which to read audio header and sample data.
+ *   @param events_out  Output stream to which DTMF events are to be written.
+ *   @param set  Families to be detected, with a bank initialized for the block
+ *   size, which is copied rather than modified, so that one set of coefficients
+ *   can be shared.  It is retuned (see goertzel_bank_copy) if the file has
+ *   another sample rate.
+ *   @param jobs  Number of threads to use if the stream can be mapped.
+ *   @param tag  Tag for each event written, or NULL (see dtmf_write_event).
+ *   @param telemetry  If not NULL, stream to which the strengths and decision
+ *   of every block of every channel are written (see telemetry.h).  The set
+ *   must then be DTMF alone.
+ *   @return 0 if successful, EOF otherwise.
+ */
+int dtmf_detect_file(FILE *audio_in, FILE *events_out, const TONE_SET *set, int jobs,
+                     const char *tag, FILE *telemetry);
+
+/*
+ * Detect DTMF events in a mapped audio file using multiple threads.
+ * The blocks of the file are divided into contiguous block-aligned chunks,
+ * one per thread, and each thread analyzes its chunk with its own bank.
+ * The per-block decisions are then written out in order, so the output is
+ * identical to that of the serial dtmf_detect.  To bound memory use for very
+ * large files, this is done in rounds of at most DETECT_ROUND_BLOCKS decisions
+ * per thread.
+ *
+ *   @param mp  Mapping of the sample data.
+ *   @param channels  Number of interleaved channels.
+ *   @param events_out  Output stream to which DTMF events are to be written.
+ *   @param set  Families shared by the threads, tuned for the sample rate of the file.
+ *   @param jobs  Number of threads to use.
+ *   @param tag  Tag for each event written, or NULL (see dtmf_write_event).
+ *   @param telemetry  Stream for telemetry records, or NULL (see dtmf_detect_file).
+ *   The strengths are then kept with the decisions until they are written.
+ *   @return 0 if successful, EOF otherwise.
+ */
+#define DETECT_ROUND_BLOCKS 65536
+int dtmf_detect_parallel(const AUDIO_MAP *mp, uint32_t channels, FILE *events_out,
+                         const TONE_SET *set, int jobs, const char *tag, FILE *telemetry);
+
+/*
+ * Detect DTMF tones in a live audio stream with bounded latency.
+ * Samples are analyzed as soon as they can be read, rather than once a whole
+ * block has been buffered, in windows of N = proto->N samples that start
+ * every hop samples; a hop smaller than N gives overlapping windows, which
+ * reduces latency without shortening the window used for analysis.
+ * A run of consecutive windows with the same symbol is a tone.  As soon as
+ * the first window of a tone is seen, a record
+ *
+ *     start<TAB>START<TAB>SYMBOL
+ *
+ * is written, where START is the index of the first sample of that window.
+ * When a window without the symbol is seen, or the input ends, a record
+ *
+ *     end<TAB>START<TAB>END<TAB>SYMBOL
+ *
+ * is written, where END is the index just past the last window of the tone.
+ * With more than one channel, each channel has its own tones, and the channel
+ * number follows the first field of each record.
+ * Tones shorter than MIN_DTMF_DURATION are not suppressed, since their start
+ * has already been reported.  The output is flushed after every record.
+ * A trailing partial window at the end of the input is not analyzed.
+ *
+ *   @param audio_in  Input stream from which to read audio header and sample data.
+ *   @param events_out  Output stream to which records are to be written.
+ *   @param proto  Bank initialized for dtmf_freqs and the window size.
+ *   @param hop  Number of samples between the starts of successive windows,
+ *   in the range [1, N].
+ *   @return 0 if successful, EOF otherwise.  A read error on the input ends
+ *   the stream like EOF does, with "end" records for the open tones, but EOF
+ *   is then returned.
+ */
+int dtmf_detect_stream(FILE *audio_in, FILE *events_out, const GOERTZEL_BANK *proto, uint32_t hop);
+
+/*
+ * Detect DTMF events in a batch of audio files using a pool of threads.
+ * Each path is either an audio file or a directory, which stands for the .au
+ * files it contains in name order.  The files are claimed one at a time by
+ * the workers of the pool, and the events of each file are written out in
+ * the order of the list, each line tagged with the path of its file.
+ *
+ *   @param paths  The files and directories to be processed.
+ *   @param count  Number of entries in paths.
+ *   @param events_out  Output stream to which DTMF events are to be written.
+ *   @param set  Families shared by all of the files (see dtmf_detect_file).
+ *   @param jobs  Number of threads in the pool.
+ *   @return 0 if every file was processed successfully, EOF otherwise.
+ */
+int dtmf_detect_batch(char **paths, int count, FILE *events_out, const TONE_SET *set,
+                      int jobs);
+
+#endif
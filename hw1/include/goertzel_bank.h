@@ -0,0 +1,111 @@
+#ifndef GOERTZEL_BANK_H
+#define GOERTZEL_BANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bank of Goertzel filters that are advanced together over the same samples.
+ *
+ * This computes exactly the same values as a set of GOERTZEL_STATE instances
+ * driven by goertzel_step/goertzel_strength, but the state is kept in
+ * structure-of-arrays form so that one pass over a block of samples updates
+ * every filter in the bank.  The filters are processed in groups of
+ * GOERTZEL_BANK_GROUP, using AVX2 or SSE2 vector instructions when the CPU
+ * supports them and a scalar loop otherwise.  Unused slots in the last group
+ * have B = 0 and are simply carried along.
+ *
+ * If GOERTZEL_FIXED is defined at compile time (make OPTIONS=-DGOERTZEL_FIXED,
+ * after make clean), the filters instead run the fixed-point iteration of
+ * goertzel_fixed.h directly on the 16-bit samples, with 32-bit state.
+ * Only the final strengths are computed in floating point.
+ */
+#define GOERTZEL_BANK_GROUP 8
+#define GOERTZEL_BANK_MAX 32   // Maximum number of filters in a bank.
+
+typedef struct goertzel_bank {
+    uint32_t N;      // Number of samples in each block to be analyzed.
+    double N2;       // N squared, used to normalize the strengths.
+    int size;        // Number of filters in the bank.
+    int width;       // size rounded up to a multiple of GOERTZEL_BANK_GROUP.
+    double rate;     // Sample rate for which the coefficients were computed.
+    int freqs[GOERTZEL_BANK_MAX];  // Frequencies of the filters, in Hz.
+    double k[GOERTZEL_BANK_MAX] __attribute__((aligned(32)));
+    double A[GOERTZEL_BANK_MAX] __attribute__((aligned(32)));
+    double B[GOERTZEL_BANK_MAX] __attribute__((aligned(32)));
+    double C[GOERTZEL_BANK_MAX] __attribute__((aligned(32)));
+                     // cos(A), used in computing the final strength.
+#ifdef GOERTZEL_FIXED
+    int32_t Bq[GOERTZEL_BANK_MAX];  // B in Q30 format.
+    int32_t s1[GOERTZEL_BANK_MAX];  // Filter state in Q15 format.
+    int32_t s2[GOERTZEL_BANK_MAX];
+#else
+    double s1[GOERTZEL_BANK_MAX] __attribute__((aligned(32)));
+    double s2[GOERTZEL_BANK_MAX] __attribute__((aligned(32)));
+#endif
+    double y[GOERTZEL_BANK_MAX] __attribute__((aligned(32)));
+                     // Strengths computed by goertzel_bank_strength.
+} GOERTZEL_BANK;
+
+/*
+ * Initialize a bank of filters for a set of frequencies.
+ *
+ *   @param bp  Pointer to the bank to be initialized.
+ *   @param N  Number of samples in each block to be analyzed.
+ *   @param freqs  Table of frequencies, in Hz.
+ *   @param size  Number of entries in freqs (at most GOERTZEL_BANK_MAX).
+ *   @param rate  Sample rate, in samples per second.  The index of the filter
+ *   for frequency F is k = N * F / rate, as for goertzel_init.
+ *   @return 0 if the bank was initialized, -1 if size is out of range or,
+ *   with GOERTZEL_FIXED, if the state of some filter could overflow.
+ */
+int goertzel_bank_init(GOERTZEL_BANK *bp, uint32_t N, const int *freqs, int size, double rate);
+
+/*
+ * Copy a bank for use on audio at a given sample rate.  If the rate differs
+ * from that of the original, the coefficients are recomputed for the same
+ * block size and frequencies, so that one bank can serve as a prototype for
+ * files recorded at different rates.
+ *
+ *   @param bp  Pointer to the bank to be initialized.
+ *   @param proto  Pointer to the bank to be copied.
+ *   @param rate  Sample rate of the audio to be analyzed.
+ *   @return 0 if the bank was initialized, -1 otherwise (see goertzel_bank_init).
+ */
+int goertzel_bank_copy(GOERTZEL_BANK *bp, const GOERTZEL_BANK *proto, double rate);
+
+/*
+ * Clear the filter state in preparation for analyzing a new block.
+ * The coefficients computed by goertzel_bank_init are retained.
+ */
+void goertzel_bank_reset(GOERTZEL_BANK *bp);
+
+/*
+ * Advance every filter in the bank over a run of 16-bit samples.
+ * Each sample y is presented to the filters as (double)y / INT16_MAX.
+ *
+ *   @param bp  Pointer to the bank.
+ *   @param x  Samples to be processed.
+ *   @param n  Number of samples.
+ */
+void goertzel_bank_run(GOERTZEL_BANK *bp, const int16_t *x, size_t n);
+
+/*
+ * Same as goertzel_bank_run, but the samples are read in their big-endian
+ * on-disk form (e.g. directly from an AUDIO_MAP), avoiding a decoding pass.
+ * The samples of one channel of interleaved audio are stride samples apart,
+ * so the channels can be analyzed in place without first being separated.
+ */
+void goertzel_bank_run_be(GOERTZEL_BANK *bp, const uint8_t *x, size_t n, uint32_t stride);
+
+/*
+ * Perform the final iteration for every filter in the bank, storing the
+ * strength of each frequency component (see goertzel_strength) into the
+ * y array of the bank.
+ *
+ *   @param bp  Pointer to the bank.
+ *   @param x  The last sample of the block.
+ */
+void goertzel_bank_strength(GOERTZEL_BANK *bp, int16_t x);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef GOERTZEL_FIXED_H
+#define GOERTZEL_FIXED_H
+
+#include <stdint.h>
+
+/*
+ * Fixed-point version of the Goertzel algorithm of goertzel.h, for 16-bit
+ * samples used as they are rather than converted to double.
+ *
+ * A sample y stands for y / INT16_MAX, as in the floating-point detector,
+ * so the samples and the filter state are in Q15 format (15 fraction bits)
+ * and the state is held in 32 bits.  The coefficient B = 2cos(A) is held in
+ * Q30 format.  Each iteration takes one 32x32->64 bit multiplication, rounded
+ * back to Q15, and the floating-point arithmetic is confined to the final
+ * strength computation, which is done once per block.
+ *
+ * The state of a filter at frequency index k over N samples is bounded by
+ * N * INT16_MAX * min(N, 1/|sin(A)|), which must fit in 32 bits; goertzel_fixed_fits
+ * checks this.  For the DTMF frequencies it holds for every block size up to 1000.
+ */
+#define GOERTZEL_FIXED_Q 30          // Fraction bits of the coefficient B.
+
+typedef struct goertzel_fixed_state {
+    uint32_t N;      // Number of samples in the signal to be analyzed.
+    double k;        // Real-valued "index" of the frequency component.
+    double A;        // Intermediate value used to compute B.
+    int32_t B;       // 2cos(A), in Q30 format.
+    int32_t s0;      // Goertzel filter state variables, in Q15 format.
+    int32_t s1;
+    int32_t s2;
+} GOERTZEL_FIXED_STATE;
+
+/*
+ * One iteration of the filter: s0 = x + B*s1 - s2, with B*s1 rounded to the
+ * nearest Q15 value.  The bank of goertzel_bank.h uses the same function, so
+ * that it gives identical results.
+ */
+static inline int32_t goertzel_fixed_iterate(int32_t B, int32_t s1, int32_t s2, int16_t x) {
+    int64_t p = ((int64_t)B * s1 + ((int64_t)1 << (GOERTZEL_FIXED_Q - 1))) >> GOERTZEL_FIXED_Q;
+    return (int32_t)(x + p - s2);
+}
+
+/*
+ * Check whether the state of a filter at frequency index k over N samples
+ * is certain to fit in 32 bits, for any input.
+ */
+int goertzel_fixed_fits(uint32_t N, double k);
+
+/*
+ * Initialize the state of a fixed-point instance of the Goertzel algorithm
+ * (see goertzel_init).
+ */
+void goertzel_fixed_init(GOERTZEL_FIXED_STATE *gp, uint32_t N, double k);
+
+/*
+ * Perform one iteration of the main loop of the algorithm on a sample.
+ */
+void goertzel_fixed_step(GOERTZEL_FIXED_STATE *gp, int16_t x);
+
+/*
+ * Perform the final iteration of the algorithm on the last sample and return
+ * the strength of the frequency component, on the same scale as goertzel_strength.
+ */
+double goertzel_fixed_strength(GOERTZEL_FIXED_STATE *gp, int16_t x);
+
+/*
+ * Strength computed from the last two values of the state (see goertzel_strength).
+ */
+double goertzel_fixed_energy(int32_t s0, int32_t s1, double C, double N2);
+
+#endif
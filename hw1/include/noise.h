@@ -0,0 +1,72 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/*
+ * Reader for the samples of a noise file, used by dtmf_generate -n.
+ *
+ * The header of the file is read and validated as for any audio file, so
+ * that the sample data is found at data_offset.  A background thread then
+ * reads ahead, decoding NOISE_BLOCK samples at a time into one of two
+ * buffers while the samples of the other are being mixed.  For a file with
+ * several channels, the noise is taken from the first channel.
+ *
+ * Once the samples of the file have all been used, noise_read either
+ * supplies zeros, or, if looping was requested, starts again from the first
+ * sample by seeking back in the file, which need not be reopened.
+ */
+#define NOISE_BLOCK 65536   // Samples decoded into each buffer at a time.
+
+typedef struct noise_reader {
+    FILE *in;               // The noise file.
+    uint32_t channels;      // Number of interleaved channels in the file.
+    off_t data;             // Offset of the first sample, to which a loop returns.
+    int loop;               // Nonzero to repeat the noise once it runs out.
+    uint8_t *raw;           // Buffer for undecoded frames.
+    int16_t *buf[2];        // Decoded samples, filled alternately.
+    size_t fill[2];         // Number of samples in each buffer.
+    int ready[2];           // Nonzero once a buffer is filled, until it is used up.
+    int cur;                // Buffer from which samples are being taken.
+    int held;               // Nonzero while the current buffer is in use.
+    size_t pos;             // Samples already taken from the current buffer.
+    size_t end;             // Number of samples in the current buffer.
+    int done;               // Nonzero once no more samples will be read.
+    int stop;               // Set to make the thread finish early.
+    int threaded;           // Nonzero if the read-ahead thread is running.
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;    // Signalled when a buffer is filled or freed.
+} NOISE_READER;
+
+/*
+ * Open a noise file and start reading ahead.
+ *
+ *   @param np  Pointer to the reader to be initialized.
+ *   @param path  Name of the noise file.
+ *   @param loop  Nonzero to repeat the noise for as long as it is read.
+ *   @return 0 if successful, EOF if the file cannot be opened or does not
+ *   have a valid header.
+ */
+int noise_open(NOISE_READER *np, const char *path, int loop);
+
+/*
+ * Take the next n noise samples.  Zeros are supplied once the noise has run
+ * out, unless it is being looped.
+ *
+ *   @param np  Pointer to the reader.
+ *   @param out  Array into which to store the samples.
+ *   @param n  Number of samples.
+ */
+void noise_read(NOISE_READER *np, int16_t *out, size_t n);
+
+/*
+ * Stop reading ahead, close the noise file, and free the buffers.
+ */
+void noise_close(NOISE_READER *np);
+
+#endif
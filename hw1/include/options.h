@@ -0,0 +1,72 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Options of the program beyond those of const.h, which is replaced during
+ * grading and so cannot be extended.  Like the globals of const.h, these are
+ * set by validargs; each is defined once, in options.c.
+ */
+
+extern int num_jobs;         // Number of threads used in DTMF tone detection.
+extern char **batch_paths;   // Audio files and directories to be processed in batch mode.
+extern int batch_count;      // Number of entries in batch_paths, or 0 to read standard input.
+extern int stream_mode;      // Nonzero for streaming detection with bounded latency.
+extern int hop_size;         // Samples between the starts of windows in streaming detection.
+extern int noise_loop;       // Nonzero to repeat the noise file until the audio output ends.
+extern char *telemetry_file; // Name of file for per-block telemetry in detection, or NULL if none.
+extern char *tone_families;  // Comma-separated families of tones to be detected, or NULL for DTMF.
+
+/*
+ * Usage message covering every option, which main prints in place of the
+ * USAGE of const.h, whose text only describes the options declared there.
+ */
+#define DTMF_USAGE(program_name, retcode) do { \
+fprintf(stderr, "USAGE: %s %s\n", program_name, \
+"[-h] -g|-d [-t MSEC] [-n NOISE_FILE [-L]] [-l LEVEL] [-b BLOCKSIZE] [-j JOBS] [-s [-H HOP]] [-T TELEMETRY_FILE]\n" \
+"           [-F FAMILIES] [FILE|DIR ...]\n" \
+"   -h       Help: displays this help menu.\n" \
+"   -g       Generate: read DTMF events from standard input, output audio data to standard output.\n" \
+"   -d       Detect: read audio data from standard input, output DTMF events to standard output.\n\n" \
+"            Optional additional parameters for -g (not permitted with -d):\n" \
+"               -t MSEC         Time duration (in milliseconds, default 1000) of the audio output.\n" \
+"               -n NOISE_FILE   specifies the name of an audio file containing \"noise\" to be combined\n" \
+"                               with the synthesized DTMF tones.\n" \
+"               -L              with -n, repeat the noise for as long as the audio output lasts,\n" \
+"                               rather than continuing without noise once NOISE_FILE runs out.\n" \
+"               -l LEVEL        specifies the loudness ratio (in dB, positive or negative) of the\n" \
+"                               noise to that of the DTMF tones.  A LEVEL of 0 (the default) means the\n" \
+"                               same level, negative values mean that the DTMF tones are louder than\n" \
+"                               the noise, positive values mean that the noise is louder than the\n" \
+"                               DTMF tones.\n\n" \
+"            Optional additional parameters for -d (not permitted with -g):\n" \
+"               -b BLOCKSIZE    specifies the number of samples (range [10, 1000], default 100)\n" \
+"                                in each block of audio to be analyzed for the presence of DTMF tones.\n" \
+"               -j JOBS         specifies the number of threads (range [1, 64], default 1) among which\n" \
+"                                the blocks are divided, when the audio input is a regular file.\n" \
+"               -s              Stream: analyze audio as it arrives, writing a \"start\" record as soon\n" \
+"                                as a tone is seen and an \"end\" record when it stops.\n" \
+"               -H HOP          with -s, start a new analysis window every HOP samples (range\n" \
+"                                [1, BLOCKSIZE], default BLOCKSIZE), overlapping the windows.\n" \
+"               -T TELEMETRY_FILE  write the strengths of the DTMF frequencies in every block, and\n" \
+"                                the decision made from them, to TELEMETRY_FILE in binary form, for\n" \
+"                                analysis with dtmf_telemetry (not permitted with -s or FILE|DIR).\n" \
+"               -F FAMILIES     detect the families of tones in the comma-separated list FAMILIES\n" \
+"                                in one pass: dtmf (the default), mf (MF R1 signalling: digits,\n" \
+"                                K for KP, S for ST, A, B, C for ST', ST'', ST'''), and cp (call\n" \
+"                                progress: D dial tone, R ringback, B busy or reorder).  Unless the\n" \
+"                                list is dtmf alone, each event is preceded by the name of its family\n" \
+"                                and a tab (not permitted with -s or -T).  cp needs a BLOCKSIZE\n" \
+"                                of at least 200 to separate its frequencies.\n" \
+"               FILE|DIR ...    process a batch of audio files (directories stand for the .au files\n" \
+"                                they contain) on a pool of JOBS threads, instead of standard input.\n" \
+"                                Each event is preceded by the name of its file and a tab.\n" \
+"            Audio with more than one channel is analyzed for every channel in one pass, and each\n" \
+"            event is then preceded by its channel number (from 0) and a tab.\n" \
+); \
+exit(retcode); \
+} while(0)
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Synthesis of DTMF tones without calling cos() for every sample.
+ *
+ * Each of the two sinusoids of a tone is generated by a recursive oscillator:
+ * the point (cos(wi), sin(wi)) is rotated by the angle w at each sample, so
+ * that one sample costs four multiplications per sinusoid.  Rounding errors
+ * in the rotation accumulate slowly, so the oscillators are reseeded from the
+ * exact phase every SYNTH_RESEED samples (at sample indices that are multiples
+ * of SYNTH_RESEED).  This keeps each value within about 1e-13 of
+ * cos(2 * M_PI * f * i / AUDIO_FRAME_RATE), so the synthesized samples agree
+ * with direct evaluation except in rare cases of rounding at the last bit.
+ *
+ * When a run of samples is rendered in bulk, SYNTH_LANES copies of each
+ * oscillator, one sample apart, are rotated together by SYNTH_LANES times the
+ * angle, so that the arithmetic for consecutive samples is independent and
+ * can be done with vector instructions.
+ */
+#define SYNTH_RESEED 500
+#define SYNTH_LANES 4
+
+typedef struct synth_osc {
+    double f;        // Frequency, in Hz.
+    double c;        // cos and sin of the phase at the current sample.
+    double s;
+    double cw;       // cos and sin of the phase increment per sample.
+    double sw;
+    double cwl;      // cos and sin of SYNTH_LANES times the phase increment.
+    double swl;
+} SYNTH_OSC;
+
+typedef struct synth_tone {
+    SYNTH_OSC row;   // Oscillator for the row frequency.
+    SYNTH_OSC col;   // Oscillator for the column frequency.
+    uint32_t index;  // Index of the next sample to be generated.
+} SYNTH_TONE;
+
+/*
+ * Set up the oscillators for a DTMF tone.
+ *
+ *   @param tp  Pointer to the tone to be initialized.
+ *   @param fr  Row frequency, in Hz.
+ *   @param fc  Column frequency, in Hz.
+ *   @param index  Index (from the start of the audio) of the first sample
+ *   that will be generated, which determines the starting phase.
+ */
+void synth_tone_init(SYNTH_TONE *tp, double fr, double fc, uint32_t index);
+
+/*
+ * Generate the next sample of a DTMF tone, equal to
+ * (int16_t)((0.5 * cos(row phase) + 0.5 * cos(column phase)) * INT16_MAX).
+ */
+int16_t synth_tone_next(SYNTH_TONE *tp);
+
+/*
+ * Generate the next n samples of a DTMF tone into an array.
+ */
+void synth_tone_render(SYNTH_TONE *tp, int16_t *out, size_t n);
+
+/*
+ * Mix the next n samples of a DTMF tone into an array of noise samples,
+ * each result being w * noise + (1 - w) * tone (see synth_noise_weight).
+ *
+ *   @param tp  The tone, or NULL to mix the noise with silence.
+ *   @param buf  On entry the noise samples, on return the mixed samples.
+ *   @param n  Number of samples.
+ *   @param w  Weight given to the noise.
+ */
+void synth_tone_mix(SYNTH_TONE *tp, int16_t *buf, size_t n, double w);
+
+/*
+ * A DTMF event to be generated: the tone with the given row and column
+ * frequencies, over the samples with indices in [start, end).
+ */
+typedef struct synth_event {
+    uint32_t start;
+    uint32_t end;
+    uint16_t row;    // Row frequency, in Hz.
+    uint16_t col;    // Column frequency, in Hz.
+} SYNTH_EVENT;
+
+/*
+ * Read the next DTMF event of a list, in the tab-separated format START, END,
+ * SYMBOL, one per line, into storage provided by the caller, so that a list of
+ * any length is taken one event at a time as the audio is generated.  A final
+ * line that ends before the tab that follows its start index is ignored, as is
+ * the character that follows each symbol.
+ *
+ *   @param in  Stream from which to read the events.
+ *   @param ep  The event to be filled in.
+ *   @return 1 if an event was read, 0 at the end of the list, EOF if the event
+ *   is malformed (a field that is not a number, an unknown symbol, a truncated
+ *   line, or a start after its end) or cannot be read.
+ */
+int synth_read_event(FILE *in, SYNTH_EVENT *ep);
+
+/*
+ * Weight given to noise when it is mixed with the tones, for a noise level
+ * in dB relative to the tones.  A mixed sample is w * noise + (1 - w) * tone.
+ */
+double synth_noise_weight(int level);
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "dtmf.h"
+
+/*
+ * Telemetry sidecar of DTMF detection (dtmf -d -T FILE).
+ *
+ * For every block of every channel, detection records the strengths of the
+ * NUM_DTMF_FREQS DTMF frequencies and the decision made from them, so that
+ * the thresholds of the decision (MINUS_20DB, FOUR_DB and SIX_DB) can be
+ * tuned offline by replaying the decision over the recorded strengths,
+ * instead of running detection again for every setting.
+ *
+ * As in an audio file, all of the fields are big-endian.  The file begins
+ * with a header of six unsigned 32-bit fields:
+ *
+ *   magic number (TELEMETRY_MAGIC), version (TELEMETRY_VERSION), block size,
+ *   sample rate, number of channels, number of frequencies
+ *
+ * followed by the frequencies themselves (unsigned 32-bit, in Hz, in the
+ * order of dtmf_freqs).  The rest of the file is a sequence of records of
+ * TELEMETRY_RECORD_SIZE bytes, in the order of the blocks and, within a
+ * block, of the channels:
+ *
+ *   start (64 bits)        index of the first frame of the block
+ *   frames (32 bits)       number of frames in the block, less than the block
+ *                          size only for the last block
+ *   channel (16 bits)      channel number, from 0
+ *   symbol (8 bits)        symbol detected in the block, or 0 if none
+ *   (8 bits, zero)
+ *   strengths (64 bits each, IEEE 754 double precision), one per frequency
+ */
+#define TELEMETRY_MAGIC (0x64746d74)   // The four ASCII characters "dtmt".
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RECORD_SIZE (16 + 8 * NUM_DTMF_FREQS)
+
+typedef struct telemetry_header {
+    uint32_t magic_number;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t num_freqs;
+    uint32_t freqs[NUM_DTMF_FREQS];
+} TELEMETRY_HEADER;
+
+typedef struct telemetry_record {
+    uint64_t start;
+    uint32_t frames;
+    uint16_t channel;
+    uint8_t symbol;
+    double y[NUM_DTMF_FREQS];
+} TELEMETRY_RECORD;
+
+/*
+ * Thresholds of the decision, as power ratios like the constants of const.h.
+ */
+typedef struct telemetry_limits {
+    double level;      // Minimum sum of the row and column maxima (MINUS_20DB).
+    double twist;      // Maximum ratio between the row and column maxima (FOUR_DB).
+    double dominance;  // Minimum ratio of a maximum to the rest of its group (SIX_DB).
+} TELEMETRY_LIMITS;
+
+/*
+ * Write the header of a telemetry file, for the frequencies of dtmf_freqs.
+ *
+ *   @return 0 if successful, EOF otherwise.
+ */
+int telemetry_write_header(FILE *out, uint32_t block_size, uint32_t sample_rate, uint32_t channels);
+
+/*
+ * Write one record of a telemetry file.
+ *
+ *   @param y  The strengths of the block, in the order of dtmf_freqs.
+ *   @return 0 if successful, EOF otherwise.
+ */
+int telemetry_write_record(FILE *out, uint64_t start, uint32_t frames, uint32_t channel,
+                           int symbol, const double *y);
+
+/*
+ * Read and validate the header of a telemetry file.
+ *
+ *   @return 0 if successful, EOF if the header could not be read or is not
+ *   that of a telemetry file that this version can read.
+ */
+int telemetry_read_header(FILE *in, TELEMETRY_HEADER *hp);
+
+/*
+ * Read the next record of a telemetry file.
+ *
+ *   @return 0 if successful, EOF at the end of the file or on error.
+ */
+int telemetry_read_record(FILE *in, TELEMETRY_RECORD *rp);
+
+/*
+ * Make the decision of dtmf_decide with other thresholds, by way of
+ * dtmf_decide_limits.  With the limits of const.h, the result is the same as
+ * that of dtmf_decide.
+ */
+int telemetry_decide(const double *y, const TELEMETRY_LIMITS *lp);
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef TONE_H
+#define TONE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "goertzel_bank.h"
+
+/*
+ * Families of dual-frequency signalling tones, detected together.
+ *
+ * A family is a table of frequencies, a map from pairs of them to symbols,
+ * and a decision that picks the symbol, if any, of a block from the
+ * strengths of its frequencies.  A set of families shares a single bank of
+ * Goertzel filters over the frequencies of all of them, so that every block
+ * is scanned once however many families are detected; each family then
+ * makes its decision from its own slice of the strengths of the bank.
+ *
+ * Three families are built in (see tone_family_find):
+ *
+ *   dtmf  The DTMF tones of dtmf_freqs, decided by dtmf_decide.
+ *   mf    The MF R1 (Bell) signalling tones, two of 700, 900, 1100, 1300,
+ *         1500 and 1700 Hz, for the digits 1-9 and 0, KP (K), ST (S), and
+ *         ST', ST'', ST''' (A, B, C).
+ *   cp    The North American call-progress tones: dial tone (D) of 350 and
+ *         440 Hz, ringback (R) of 440 and 480 Hz, and busy or reorder (B) of
+ *         480 and 620 Hz.  Busy and reorder differ only in their cadence, which
+ *         is seen in the events and not in any one block.
+ *
+ * A filter responds to frequencies within about rate/N Hz of its own, so the
+ * close frequencies of cp need blocks of at least 200 samples at 8 kHz, and a
+ * DTMF tone is also reported as MF when its frequencies are close to those of
+ * an MF tone (697 and 700 Hz, for example) if both families are detected.
+ *
+ * Families other than dtmf use a generic decision, with the thresholds of
+ * the family: the two strongest frequencies must together reach the level
+ * threshold, must be within the twist threshold of each other, and must both
+ * dominate every other frequency of the family by the dominance threshold.
+ */
+#define TONE_MAX_FAMILIES 4     // Maximum number of families in a set.
+#define TONE_MAX_FREQS 8        // Maximum number of frequencies in a family.
+
+typedef struct tone_family {
+    const char *name;           // Name of the family, as given to -F.
+    int size;                   // Number of frequencies.
+    int freqs[TONE_MAX_FREQS];  // Frequencies, in Hz.
+    uint8_t symbols[TONE_MAX_FREQS][TONE_MAX_FREQS];
+                                // Symbol of each pair of frequencies (i < j), or 0 if none.
+    double level;               // Minimum sum of the two strongest strengths.
+    double twist;               // Maximum ratio of the two strongest strengths.
+    double dominance;           // Minimum ratio of the weaker of the two to any other.
+    int (*decide)(const struct tone_family *fp, const double *y);
+                                // Decision from the strengths of the frequencies.
+} TONE_FAMILY;
+
+/*
+ * A set of families and the bank of filters shared by them.
+ */
+typedef struct tone_set {
+    GOERTZEL_BANK bank;         // Filters for the frequencies of every family, in turn.
+    int count;                  // Number of families.
+    const TONE_FAMILY *families[TONE_MAX_FAMILIES];
+    int offset[TONE_MAX_FAMILIES];  // Index in the bank of the first frequency of each family.
+    int named;                  // Nonzero if events are to be tagged with the family name,
+                                // which is the case unless the set is dtmf alone.
+} TONE_SET;
+
+/*
+ * Look up a built-in family by name.
+ *
+ *   @param name  The name, which need not be null-terminated.
+ *   @param len  Length of the name.
+ *   @return The family, or NULL if there is none of that name.
+ */
+const TONE_FAMILY *tone_family_find(const char *name, size_t len);
+
+/*
+ * Parse a comma-separated list of family names, such as "dtmf,cp".
+ *
+ *   @param list  The list.
+ *   @param families  Array into which to store the families, in the order given.
+ *   @return The number of families, or -1 if a name is unknown or repeated, or
+ *   there are more than TONE_MAX_FAMILIES.
+ */
+int tone_parse_families(const char *list, const TONE_FAMILY **families);
+
+/*
+ * Parse a comma-separated list of family names into the families of a set,
+ * without building its bank (see tone_set_bank), so that a list can be checked
+ * before the block size is known.
+ *
+ *   @param sp  Pointer to the set whose families and count are to be set.
+ *   @param list  The list (see tone_parse_families).
+ *   @return The number of families, or -1 if the list is invalid, in which
+ *   case the set is unspecified.
+ */
+int tone_set_parse(TONE_SET *sp, const char *list);
+
+/*
+ * Build the bank of a set for the frequencies of its families, which have
+ * been set by tone_set_parse.
+ *
+ *   @param sp  Pointer to the set.
+ *   @param N  Block size (see goertzel_bank_init).
+ *   @param rate  Sample rate (see goertzel_bank_init).
+ *   @return 0 if the bank was built, -1 if the families have more frequencies
+ *   in all than a bank can hold, or the bank cannot be initialized.
+ */
+int tone_set_bank(TONE_SET *sp, uint32_t N, double rate);
+
+/*
+ * Initialize a set of families, with a bank for all of their frequencies.
+ *
+ *   @param sp  Pointer to the set to be initialized.
+ *   @param families  The families.
+ *   @param count  Number of families, from 1 to TONE_MAX_FAMILIES.
+ *   @param N  Block size (see goertzel_bank_init).
+ *   @param rate  Sample rate (see goertzel_bank_init).
+ *   @return 0 if the set was initialized, -1 if the families have more
+ *   frequencies in all than a bank can hold, or the bank cannot be initialized.
+ */
+int tone_set_init(TONE_SET *sp, const TONE_FAMILY **families, int count, uint32_t N, double rate);
+
+/*
+ * Decide which symbol of a family, if any, is present in a block, with the
+ * generic decision described above.
+ *
+ *   @param fp  The family.
+ *   @param y  The strengths of the frequencies of the family, in order.
+ *   @return The symbol, or 0 if none.
+ */
+int tone_decide(const TONE_FAMILY *fp, const double *y);
+
+#endif
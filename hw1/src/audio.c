@@ -1,11 +1,22 @@
 #include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "audio.h"
+#include "audio_io.h"
 #include "debug.h"
 
+/*
+ * Besides the checks documented in audio.h, which were written for monaural
+ * 8000 Hz files, any number of channels in [1, AUDIO_MAX_CHANNELS] is accepted
+ * (see audio_io.h), and so is any sample rate but 0: the detectors analyze
+ * every channel and tune their filters to the rate of the file.  A sample rate
+ * of 0 is rejected, since no frequency can be derived from it.
+ */
 int audio_read_header(FILE *in, AUDIO_HEADER *hp) {
 	//read first 24 bytes of file header and place into AUDIO_HEADER struct
-	char ch;
+	int ch;
 	(*hp).magic_number = 0;
     for (int i = 0; i < 4; i++){
     	if ((ch = fgetc(in)) == EOF){
@@ -55,9 +66,21 @@ int audio_read_header(FILE *in, AUDIO_HEADER *hp) {
     if ((*hp).encoding != PCM16_ENCODING){
     	return EOF;
     }
-    if ((*hp).channels != AUDIO_CHANNELS){
+    if ((*hp).channels < 1 || (*hp).channels > AUDIO_MAX_CHANNELS){
     	return EOF;
     }
+    if ((*hp).sample_rate == 0){
+    	return EOF;
+    }
+    if ((*hp).data_offset < AUDIO_DATA_OFFSET){
+    	return EOF;
+    }
+    //skip any annotation so that the stream is left at the first sample
+    for (uint32_t i = AUDIO_DATA_OFFSET; i < (*hp).data_offset; i++){
+    	if (fgetc(in) == EOF){
+    		return EOF;
+    	}
+    }
     return 0;
 }
 
@@ -120,3 +143,104 @@ int audio_write_sample(FILE *out, int16_t sample) {
     }
     return 0;
 }
+
+int16_t sample_buf[SAMPLE_BUF_SIZE];
+
+size_t audio_read_samples(FILE *in, int16_t *samples, size_t n) {
+    //read raw big-endian data straight into the caller's array
+    size_t count = fread(samples, AUDIO_BYTES_PER_SAMPLE, n, in);
+    uint8_t *bytes = (uint8_t *)samples;
+    //decode in place; each sample only touches its own two bytes
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = audio_decode_sample(bytes + 2*i);
+    }
+    return count;
+}
+
+#define AUDIO_WRITE_CHUNK 2048 //samples encoded per fwrite
+
+size_t audio_write_samples(FILE *out, const int16_t *samples, size_t n) {
+    uint8_t bytes[AUDIO_WRITE_CHUNK * AUDIO_BYTES_PER_SAMPLE];
+    size_t done = 0;
+    while (done < n) {
+        size_t count = n - done;
+        if (count > AUDIO_WRITE_CHUNK) {
+            count = AUDIO_WRITE_CHUNK;
+        }
+        //encode a chunk in big-endian byte order
+        for (size_t i = 0; i < count; i++) {
+            uint16_t sample = (uint16_t)samples[done + i];
+            bytes[2*i] = sample >> 8;
+            bytes[2*i + 1] = sample & 0xff;
+        }
+        size_t written = fwrite(bytes, AUDIO_BYTES_PER_SAMPLE, count, out);
+        done += written;
+        if (written < count) {
+            break;
+        }
+    }
+    return done;
+}
+
+#define AUDIO_SPARSE_MIN 65536 //bytes of silence worth leaving as a hole
+
+size_t audio_write_silence(FILE *out, size_t n) {
+    static const uint8_t zeros[AUDIO_WRITE_CHUNK * AUDIO_BYTES_PER_SAMPLE];
+    size_t bytes = n * AUDIO_BYTES_PER_SAMPLE;
+    struct stat st;
+    int fd = fileno(out);
+    off_t pos;
+    //seek over the run if the file is known to read as zeros beyond its end
+    if (bytes >= AUDIO_SPARSE_MIN && fflush(out) == 0 && fd >= 0 && fstat(fd, &st) == 0
+        && S_ISREG(st.st_mode) && !(fcntl(fd, F_GETFL) & O_APPEND)
+        && (pos = ftello(out)) >= 0 && pos >= st.st_size
+        && fseeko(out, bytes - AUDIO_BYTES_PER_SAMPLE, SEEK_CUR) == 0) {
+        //write the last sample, so that the file really is extended
+        return fwrite(zeros, AUDIO_BYTES_PER_SAMPLE, 1, out) == 1 ? n : 0;
+    }
+    size_t done = 0;
+    while (done < n) {
+        size_t count = n - done;
+        if (count > AUDIO_WRITE_CHUNK) {
+            count = AUDIO_WRITE_CHUNK;
+        }
+        size_t written = fwrite(zeros, AUDIO_BYTES_PER_SAMPLE, count, out);
+        done += written;
+        if (written < count) {
+            break;
+        }
+    }
+    return done;
+}
+
+int audio_map_samples(FILE *in, AUDIO_MAP *mp) {
+    struct stat st;
+    int fd = fileno(in);
+    mp->base = NULL;
+    //only regular files can be mapped; pipes and terminals use stdio
+    if (fd < 0 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return EOF;
+    }
+    //the stream has already been advanced past the header and annotation
+    off_t pos = ftello(in);
+    if (pos < 0 || st.st_size <= pos) {
+        return EOF;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        return EOF;
+    }
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+    mp->base = base;
+    mp->length = st.st_size;
+    mp->data = (const uint8_t *)base + pos;
+    mp->samples = (st.st_size - pos) / AUDIO_BYTES_PER_SAMPLE;
+    return 0;
+}
+
+void audio_unmap_samples(AUDIO_MAP *mp) {
+    if (mp->base != NULL) {
+        munmap(mp->base, mp->length);
+        mp->base = NULL;
+    }
+}
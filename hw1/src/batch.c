@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "const.h"
+#include "detect.h"
+#include "debug.h"
+
+/*
+ * One audio file of a batch, and the events detected in it.
+ */
+typedef struct batch_item {
+    char *path;       // Path of the audio file, used to tag its events.
+    char *events;     // Event text for the file, once it has been processed.
+    size_t length;    // Length of the event text.
+    int status;       // 0 if the file was processed successfully, EOF otherwise.
+    int done;         // Nonzero once a worker has finished with the file.
+} BATCH_ITEM;
+
+/*
+ * State shared between the workers of the pool and the thread that
+ * writes out the results.
+ */
+typedef struct batch {
+    BATCH_ITEM *items;
+    size_t count;
+    size_t next;                  // Index of the next item to be claimed.
+    const TONE_SET *set;          // Families and coefficients shared by every file.
+    pthread_mutex_t lock;
+    pthread_cond_t done;          // Signalled whenever an item is finished.
+} BATCH;
+
+/* batch_compare - order paths bytewise, for a stable directory listing */
+static int batch_compare(const void *p1, const void *p2) {
+    const unsigned char *s1 = (const unsigned char *)((const BATCH_ITEM *)p1)->path;
+    const unsigned char *s2 = (const unsigned char *)((const BATCH_ITEM *)p2)->path;
+    while (*s1 != '\0' && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    return *s1 - *s2;
+}
+
+/* batch_is_audio - check for the .au suffix */
+static int batch_is_audio(const char *name) {
+    const char *end = name;
+    while (*end != '\0') {
+        end++;
+    }
+    return end - name > 3 && *(end - 3) == '.' && *(end - 2) == 'a' && *(end - 1) == 'u';
+}
+
+/* batch_add - append a path to the list of items, growing it as needed */
+static int batch_add(BATCH *bp, size_t *max, char *path) {
+    if (bp->count == *max) {
+        size_t grow = *max == 0 ? 64 : *max * 2;
+        BATCH_ITEM *items = realloc(bp->items, grow * sizeof(BATCH_ITEM));
+        if (items == NULL) {
+            free(path);
+            return EOF;
+        }
+        bp->items = items;
+        *max = grow;
+    }
+    BATCH_ITEM *ip = bp->items + bp->count++;
+    ip->path = path;
+    ip->events = NULL;
+    ip->length = 0;
+    ip->status = 0;
+    ip->done = 0;
+    return 0;
+}
+
+/*
+ * batch_expand - build the list of files to be processed.  Directories are
+ * replaced by the .au files they contain, in name order; other paths are
+ * taken as given.
+ */
+static int batch_expand(BATCH *bp, char **paths, int count) {
+    size_t max = 0;
+    for (int i = 0; i < count; i++) {
+        char *path = *(paths + i);
+        struct stat st;
+        DIR *dir;
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode) && (dir = opendir(path)) != NULL) {
+            size_t first = bp->count;
+            struct dirent *de;
+            while ((de = readdir(dir)) != NULL) {
+                if (!batch_is_audio(de->d_name)) {
+                    continue;
+                }
+                int len = snprintf(NULL, 0, "%s/%s", path, de->d_name);
+                char *full = malloc(len + 1);
+                if (full == NULL || batch_add(bp, &max, full) == EOF) {
+                    closedir(dir);
+                    return EOF;
+                }
+                snprintf(full, len + 1, "%s/%s", path, de->d_name);
+            }
+            closedir(dir);
+            qsort(bp->items + first, bp->count - first, sizeof(BATCH_ITEM), batch_compare);
+            continue;
+        }
+        int len = snprintf(NULL, 0, "%s", path);
+        char *copy = malloc(len + 1);
+        if (copy == NULL || batch_add(bp, &max, copy) == EOF) {
+            return EOF;
+        }
+        snprintf(copy, len + 1, "%s", path);
+    }
+    return 0;
+}
+
+/*
+ * batch_worker - claim files one at a time and detect events in each,
+ * collecting the tagged event lines in memory until they are written out.
+ */
+static void *batch_worker(void *arg) {
+    BATCH *bp = arg;
+    while (1) {
+        pthread_mutex_lock(&bp->lock);
+        size_t i = bp->next++;
+        pthread_mutex_unlock(&bp->lock);
+        if (i >= bp->count) {
+            break;
+        }
+        BATCH_ITEM *ip = bp->items + i;
+        FILE *in = fopen(ip->path, "r");
+        FILE *out = open_memstream(&ip->events, &ip->length);
+        if (in == NULL || out == NULL) {
+            ip->status = EOF;
+        }
+        else {
+            ip->status = dtmf_detect_file(in, out, bp->set, 1, ip->path, NULL);
+        }
+        if (out != NULL) {
+            fclose(out);
+        }
+        if (in != NULL) {
+            fclose(in);
+        }
+        pthread_mutex_lock(&bp->lock);
+        ip->done = 1;
+        pthread_cond_broadcast(&bp->done);
+        pthread_mutex_unlock(&bp->lock);
+    }
+    return NULL;
+}
+
+int dtmf_detect_batch(char **paths, int count, FILE *events_out, const TONE_SET *set,
+                      int jobs) {
+    BATCH batch = { NULL, 0, 0, set };
+    int ret = 0;
+    if (batch_expand(&batch, paths, count) == EOF) {
+        ret = EOF;
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.done, NULL);
+    pthread_t tid[MAX_DETECT_JOBS];
+    int started = 0;
+    for (int j = 0; ret == 0 && j < jobs && j < batch.count; j++) {
+        if (pthread_create(tid + j, NULL, batch_worker, &batch) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (ret == 0 && started == 0) {
+        //no threads could be created; process the batch on this thread
+        batch_worker(&batch);
+    }
+    //write the results out in order, as soon as each file is finished
+    for (size_t i = 0; ret == 0 && i < batch.count; i++) {
+        BATCH_ITEM *ip = batch.items + i;
+        pthread_mutex_lock(&batch.lock);
+        while (!ip->done) {
+            pthread_cond_wait(&batch.done, &batch.lock);
+        }
+        pthread_mutex_unlock(&batch.lock);
+        if (ip->length > 0 && fwrite(ip->events, 1, ip->length, events_out) != ip->length) {
+            ret = EOF;
+        }
+        if (ip->status == EOF) {
+            fprintf(stderr, "%s: not a readable PCM16 audio file\n", ip->path);
+        }
+        free(ip->events);
+        ip->events = NULL;
+    }
+    //on a write error, let the workers run out of items before cleaning up
+    pthread_mutex_lock(&batch.lock);
+    batch.next = batch.count;
+    pthread_mutex_unlock(&batch.lock);
+    for (int j = 0; j < started; j++) {
+        pthread_join(*(tid + j), NULL);
+    }
+    for (size_t i = 0; i < batch.count; i++) {
+        if ((batch.items + i)->status == EOF) {
+            ret = EOF;
+        }
+        free((batch.items + i)->events);
+        free((batch.items + i)->path);
+    }
+    free(batch.items);
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.done);
+    return ret;
+}
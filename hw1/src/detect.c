@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DETECT_X86
+#endif
+
+#include "const.h"
+#include "detect.h"
+#include "telemetry.h"
+#include "tone.h"
+#include "debug.h"
+
+/*
+ * The decision is made without branches, so that its cost does not depend on
+ * how predictable the sequence of blocks is.  The maxima of the row and column
+ * groups are found, and the level, twist, and 6dB dominance criteria are all
+ * tested with multiplications rather than the divisions of the original ratio
+ * tests, e.g. max/y < SIX_DB as max < SIX_DB * y.  A strength is never
+ * greater than the maximum of its group, so "not the maximum" is y < max.
+ * A negative strength (even -0.0) fails the dominance test, since the original
+ * ratio was then negative.  The index of a maximum is that of the first strength equal
+ * to it, so ties resolve as before.  The SSE2 kernel is used on x86; elsewhere
+ * the scalar dtmf_decide_limits is used, which takes the thresholds as
+ * parameters so that the telemetry replay makes the very same decision.
+ */
+#ifdef DETECT_X86
+static int decide_kernel(const double *y) {
+    __m128d zero = _mm_setzero_pd();
+    __m128d six = _mm_set1_pd(SIX_DB);
+    __m128d r01 = _mm_loadu_pd(y), r23 = _mm_loadu_pd(y + 2);
+    __m128d c01 = _mm_loadu_pd(y + 4), c23 = _mm_loadu_pd(y + 6);
+    //row maximum in the low lane, column maximum in the high lane
+    __m128d m01 = _mm_max_pd(_mm_unpacklo_pd(r01, c01), _mm_unpackhi_pd(r01, c01));
+    __m128d m23 = _mm_max_pd(_mm_unpacklo_pd(r23, c23), _mm_unpackhi_pd(r23, c23));
+    __m128d m = _mm_max_pd(_mm_max_pd(m01, m23), zero);
+    __m128d mr = _mm_unpacklo_pd(m, m), mc = _mm_unpackhi_pd(m, m);
+    //dominance: no other strength within 6dB of the maximum, and none negative;
+    //only the sign bits of bad are used
+    __m128d bad = _mm_or_pd(
+        _mm_or_pd(_mm_and_pd(_mm_cmplt_pd(r01, mr), _mm_cmplt_pd(mr, _mm_mul_pd(six, r01))),
+                  _mm_and_pd(_mm_cmplt_pd(r23, mr), _mm_cmplt_pd(mr, _mm_mul_pd(six, r23)))),
+        _mm_or_pd(_mm_and_pd(_mm_cmplt_pd(c01, mc), _mm_cmplt_pd(mc, _mm_mul_pd(six, c01))),
+                  _mm_and_pd(_mm_cmplt_pd(c23, mc), _mm_cmplt_pd(mc, _mm_mul_pd(six, c23)))));
+    //a negative strength shows up in the sign bits of the or of all of them
+    bad = _mm_or_pd(bad, _mm_or_pd(_mm_or_pd(r01, r23), _mm_or_pd(c01, c23)));
+    //twist: neither maximum more than 4dB above the other
+    __m128d twist = _mm_cmpgt_pd(m, _mm_mul_pd(_mm_set1_pd(FOUR_DB), _mm_shuffle_pd(m, m, 1)));
+    //level: the sum of the maxima is at least -20dB
+    __m128d level = _mm_cmplt_sd(_mm_add_sd(m, _mm_unpackhi_pd(m, m)), _mm_set_sd(MINUS_20DB));
+    int ok = (_mm_movemask_pd(_mm_or_pd(bad, twist)) | (_mm_movemask_pd(level) & 1)) == 0;
+    unsigned rows = _mm_movemask_pd(_mm_cmpeq_pd(r01, mr)) | _mm_movemask_pd(_mm_cmpeq_pd(r23, mr)) << 2;
+    unsigned cols = _mm_movemask_pd(_mm_cmpeq_pd(c01, mc)) | _mm_movemask_pd(_mm_cmpeq_pd(c23, mc)) << 2;
+    int symbol = *(*(dtmf_symbol_names + (__builtin_ctz(rows | 16) & 3)) + (__builtin_ctz(cols | 16) & 3));
+    return ok ? symbol : 0;
+}
+#endif
+
+/* decide_group - maximum of a group of four strengths, and its index */
+static inline int decide_group(const double *y, double dominance, double *maxp, int *badp) {
+    double y0 = *(y + 0), y1 = *(y + 1), y2 = *(y + 2), y3 = *(y + 3);
+    double m01 = y0 > y1 ? y0 : y1, m23 = y2 > y3 ? y2 : y3;
+    double m = m01 > m23 ? m01 : m23;
+    m = m > 0 ? m : 0;
+    //signbit, rather than < 0, so that -0.0 fails as in the SSE2 kernel
+    *badp = (signbit(y0) != 0) | (signbit(y1) != 0) | (signbit(y2) != 0) | (signbit(y3) != 0)
+          | ((y0 < m) & (m < dominance * y0)) | ((y1 < m) & (m < dominance * y1))
+          | ((y2 < m) & (m < dominance * y2)) | ((y3 < m) & (m < dominance * y3));
+    *maxp = m;
+    unsigned mask = (y0 >= m) | (y1 >= m) << 1 | (y2 >= m) << 2 | (y3 >= m) << 3;
+    return __builtin_ctz(mask | 16);
+}
+
+int dtmf_decide_limits(const double *y, double level, double twist, double dominance) {
+    double maxRow, maxColumn;
+    int badRow, badColumn;
+    int rowInd = decide_group(y, dominance, &maxRow, &badRow);
+    int columnInd = decide_group(y + 4, dominance, &maxColumn, &badColumn);
+    int ok = !(maxRow + maxColumn < level)
+           & !(maxRow > twist * maxColumn) & !(maxColumn > twist * maxRow)
+           & !badRow & !badColumn;
+    int symbol = *(*(dtmf_symbol_names + (rowInd & 3)) + (columnInd & 3));
+    return ok ? symbol : 0;
+}
+
+#ifndef DETECT_X86
+static int decide_kernel(const double *y) {
+    return dtmf_decide_limits(y, MINUS_20DB, FOUR_DB, SIX_DB);
+}
+#endif
+
+int dtmf_decide(const double *y) {
+    return decide_kernel(y);
+}
+
+int dtmf_analyze_block(GOERTZEL_BANK *bp, const int16_t *x, uint32_t n) {
+    uint32_t N = bp->N;
+    //the last sample of a short block is taken to be zero
+    uint32_t steps = n < N ? n : N - 1;
+    int16_t last = n < N ? 0 : *(x + N - 1);
+    goertzel_bank_reset(bp);
+    goertzel_bank_run(bp, x, steps);
+    goertzel_bank_strength(bp, last);
+    return dtmf_decide(bp->y);
+}
+
+/* analyze_be - the strengths of one block of big-endian samples, into bp->y */
+static void analyze_be(GOERTZEL_BANK *bp, const uint8_t *x, uint32_t n, uint32_t stride) {
+    uint32_t N = bp->N;
+    uint32_t steps = n < N ? n : N - 1;
+    int16_t last = n < N ? 0 : audio_decode_sample(x + (size_t)(N - 1) * stride * AUDIO_BYTES_PER_SAMPLE);
+    goertzel_bank_reset(bp);
+    goertzel_bank_run_be(bp, x, steps, stride);
+    goertzel_bank_strength(bp, last);
+}
+
+int dtmf_analyze_block_be(GOERTZEL_BANK *bp, const uint8_t *x, uint32_t n, uint32_t stride) {
+    analyze_be(bp, x, n, stride);
+    return dtmf_decide(bp->y);
+}
+
+int tone_analyze_block_be(GOERTZEL_BANK *bp, const TONE_SET *sp, const uint8_t *x, uint32_t n,
+                          uint32_t stride, uint8_t *symbols) {
+    //one pass of the filters serves every family
+    analyze_be(bp, x, n, stride);
+    int found = 0;
+    for (int f = 0; f < sp->count; f++) {
+        const TONE_FAMILY *fp = sp->families[f];
+        *(symbols + f) = fp->decide(fp, bp->y + sp->offset[f]);
+        found |= *(symbols + f);
+    }
+    return found != 0;
+}
+
+int dtmf_write_event(FILE *out, const char *tag, int channel, const char *family, size_t start,
+                     size_t end, int symbol) {
+    if (tag != NULL && fprintf(out, "%s\t", tag) < 0) {
+        return EOF;
+    }
+    if (channel >= 0 && fprintf(out, "%d\t", channel) < 0) {
+        return EOF;
+    }
+    if (family != NULL && fprintf(out, "%s\t", family) < 0) {
+        return EOF;
+    }
+    if (fprintf(out, "%zu\t%zu\t%c\n", start, end, symbol) < 0) {
+        return EOF;
+    }
+    return 0;
+}
+
+/*
+ * write_events - write the events of the families of a set that were detected
+ * in one block of one channel.
+ */
+static int write_events(FILE *out, const char *tag, int channel, const TONE_SET *sp,
+                        size_t start, size_t end, const uint8_t *symbols) {
+    for (int f = 0; f < sp->count; f++) {
+        if (*(symbols + f) != 0 && dtmf_write_event(out, tag, channel,
+                sp->named ? sp->families[f]->name : NULL, start, end, *(symbols + f)) == EOF) {
+            return EOF;
+        }
+    }
+    return 0;
+}
+
+int dtmf_detect_file(FILE *audio_in, FILE *events_out, const TONE_SET *set, int jobs,
+                     const char *tag, FILE *telemetry) {
+    size_t start;
+    size_t end;
+    size_t currIndex = 0;
+    uint8_t symbols[TONE_MAX_FAMILIES];
+    AUDIO_HEADER header;
+    if (audio_read_header(audio_in, &header) == EOF) {
+        return EOF;
+    }
+    //telemetry holds the strengths of the DTMF frequencies alone
+    if (telemetry != NULL && set->named) {
+        return EOF;
+    }
+    //the coefficients depend on the sample rate of this particular file
+    TONE_SET tones = *set;
+    if (goertzel_bank_copy(&tones.bank, &set->bank, header.sample_rate) == -1) {
+        return EOF;
+    }
+    GOERTZEL_BANK *bp = &tones.bank;
+    uint32_t C = header.channels;
+    size_t frame = (size_t)C * AUDIO_BYTES_PER_SAMPLE;
+    if (telemetry != NULL && telemetry_write_header(telemetry, bp->N, header.sample_rate, C) == EOF) {
+        return EOF;
+    }
+    //regular files are scanned in place through a mapping instead of stdio
+    AUDIO_MAP map;
+    int mapped = (audio_map_samples(audio_in, &map) == 0);
+    size_t frames = mapped ? map.samples / C : 0;
+    size_t consumed = 0; //frames of the mapping already analyzed
+    const uint8_t *bytes = NULL; //current block of interleaved frames
+    uint8_t *buf = NULL; //current block read from the stream
+    uint32_t N = bp->N;
+    if (mapped && jobs > 1) {
+        //a mapped file can be split into chunks for several threads
+        int ret = dtmf_detect_parallel(&map, C, events_out, &tones, jobs, tag, telemetry);
+        audio_unmap_samples(&map);
+        return ret;
+    }
+    if (!mapped && (buf = malloc(N * frame)) == NULL) {
+        return EOF;
+    }
+    int ret = 0;
+    int done = 0;
+    while (!done && ret == 0){
+        start = currIndex;
+        //take a whole block at once; a short block means EOF was reached
+        uint32_t n;
+        if (mapped) {
+            n = N;
+            if (frames - consumed < N) {
+                n = frames - consumed;
+            }
+            bytes = map.data + consumed * frame;
+            consumed += n;
+        }
+        else {
+            n = fread(buf, frame, N, audio_in);
+            bytes = buf;
+        }
+        if (n < N) {
+            done = 1;
+        }
+        end = dtmf_block_end(start, n, N);
+        currIndex = end;
+        //every channel is analyzed in place from the interleaved frames
+        for (uint32_t ch = 0; ch < C && ret == 0; ch++) {
+            int found = tone_analyze_block_be(bp, &tones, bytes + ch * AUDIO_BYTES_PER_SAMPLE, n, C,
+                                              symbols);
+            if (telemetry != NULL) {
+                ret = telemetry_write_record(telemetry, start, n, ch, *symbols, bp->y);
+            }
+            if (found && ret == 0) {
+                ret = write_events(events_out, tag, C > 1 ? (int)ch : -1, &tones, start, end, symbols);
+            }
+        }
+    }
+    if (mapped) {
+        audio_unmap_samples(&map);
+    }
+    free(buf);
+    return ret;
+}
+
+/*
+ * Work assigned to one thread: a contiguous run of blocks of the mapping.
+ */
+typedef struct detect_job {
+    const AUDIO_MAP *mp;
+    uint32_t channels;     // Number of interleaved channels in the mapping.
+    size_t frames;         // Number of complete frames in the mapping.
+    size_t first;          // Index of the first block of the chunk.
+    size_t count;          // Number of blocks in the chunk.
+    const TONE_SET *set;   // Families to be detected.
+    uint8_t *symbols;      // Decision for each family in each channel of each block of
+                           // the chunk (0 if none), in the order of the frames.
+    double *strengths;     // Strengths behind each decision, for telemetry, or NULL.
+    GOERTZEL_BANK bank;    // Filter state private to this thread.
+} DETECT_JOB;
+
+static void *detect_worker(void *arg) {
+    DETECT_JOB *jp = arg;
+    uint32_t N = jp->bank.N;
+    uint32_t C = jp->channels;
+    int F = jp->set->count;
+    for (size_t b = 0; b < jp->count; b++) {
+        size_t start = (jp->first + b) * N;
+        size_t left = jp->frames - start;
+        uint32_t n = left < N ? left : N;
+        const uint8_t *bytes = jp->mp->data + start * C * AUDIO_BYTES_PER_SAMPLE;
+        for (uint32_t ch = 0; ch < C; ch++) {
+            tone_analyze_block_be(&jp->bank, jp->set, bytes + ch * AUDIO_BYTES_PER_SAMPLE, n, C,
+                                  jp->symbols + (b * C + ch) * F);
+            if (jp->strengths != NULL) {
+                double *y = jp->strengths + (b * C + ch) * NUM_DTMF_FREQS;
+                for (int i = 0; i < NUM_DTMF_FREQS; i++) {
+                    *(y + i) = *(jp->bank.y + i);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+int dtmf_detect_parallel(const AUDIO_MAP *mp, uint32_t channels, FILE *events_out,
+                         const TONE_SET *set, int jobs, const char *tag, FILE *telemetry) {
+    uint32_t N = set->bank.N;
+    uint32_t C = channels;
+    int F = set->count;
+    size_t frames = mp->samples / C;
+    //the input always ends with a (possibly empty) short block
+    size_t nblocks = frames / N + 1;
+    //a round holds the same number of decisions whatever the number of channels
+    size_t per_job = DETECT_ROUND_BLOCKS / C > 0 ? DETECT_ROUND_BLOCKS / C : 1;
+    size_t width = (size_t)C * F; //decisions in each block
+    size_t round = (size_t)jobs * per_job;
+    DETECT_JOB *job = calloc(jobs, sizeof(DETECT_JOB));
+    pthread_t *tid = calloc(jobs, sizeof(pthread_t));
+    size_t most = (round < nblocks ? round : nblocks) * C; //analyses in a round
+    uint8_t *symbols = malloc(most * F);
+    double *strengths = NULL;
+    if (telemetry != NULL) {
+        strengths = malloc(most * NUM_DTMF_FREQS * sizeof(double));
+    }
+    if (job == NULL || tid == NULL || symbols == NULL || (telemetry != NULL && strengths == NULL)) {
+        free(job);
+        free(tid);
+        free(symbols);
+        free(strengths);
+        return EOF;
+    }
+    for (int j = 0; j < jobs; j++) {
+        (job + j)->mp = mp;
+        (job + j)->channels = C;
+        (job + j)->frames = frames;
+        (job + j)->bank = set->bank;
+        (job + j)->set = set;
+    }
+    int ret = 0;
+    for (size_t base = 0; base < nblocks && ret == 0; base += round) {
+        size_t count = nblocks - base < round ? nblocks - base : round;
+        //split this round into one block-aligned chunk per thread
+        size_t per = count / jobs, extra = count % jobs, next = 0;
+        for (int j = 0; j < jobs; j++) {
+            DETECT_JOB *jp = job + j;
+            jp->first = base + next;
+            jp->count = per + (j < extra ? 1 : 0);
+            jp->symbols = symbols + next * width;
+            jp->strengths = strengths != NULL ? strengths + next * C * NUM_DTMF_FREQS : NULL;
+            next += jp->count;
+            if (jp->count == 0) {
+                continue;
+            }
+            if (pthread_create(tid + j, NULL, detect_worker, jp) != 0) {
+                //no thread available; do this chunk on the calling thread
+                detect_worker(jp);
+                jp->count = 0;
+            }
+        }
+        for (int j = 0; j < jobs; j++) {
+            if ((job + j)->count != 0) {
+                pthread_join(*(tid + j), NULL);
+            }
+        }
+        //merge the decisions in block order
+        for (size_t b = 0; b < count && ret == 0; b++) {
+            size_t start = (base + b) * N;
+            size_t left = frames - start;
+            uint32_t n = left < N ? left : N;
+            for (uint32_t ch = 0; ch < C && ret == 0; ch++) {
+                const uint8_t *decided = symbols + b * width + ch * F;
+                if (telemetry != NULL) {
+                    ret = telemetry_write_record(telemetry, start, n, ch, *decided,
+                                                 strengths + (b * C + ch) * NUM_DTMF_FREQS);
+                }
+                if (ret == 0) {
+                    ret = write_events(events_out, tag, C > 1 ? (int)ch : -1, set, start,
+                                       dtmf_block_end(start, n, N), decided);
+                }
+            }
+        }
+        debug("Detected blocks [%zu, %zu) on %d threads", base, base + count, jobs);
+    }
+    free(job);
+    free(tid);
+    free(symbols);
+    free(strengths);
+    return ret;
+}
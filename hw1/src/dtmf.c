@@ -4,10 +4,16 @@
 #include <math.h>
 
 #include "const.h"
+#include "options.h"
 #include "audio.h"
+#include "audio_io.h"
 #include "dtmf.h"
 #include "dtmf_static.h"
 #include "goertzel.h"
+#include "goertzel_bank.h"
+#include "detect.h"
+#include "synth.h"
+#include "noise.h"
 #include "debug.h"
 
 #ifdef _STRING_H
@@ -67,25 +73,46 @@ int stringToInt(char *str){
   return sum;
 }
 
+/*
+ * Write a span of n samples, which are either a tone or silence, mixed with
+ * noise if there is a noise file.  Silence without noise is written in bulk.
+ */
+static int generate_span(FILE *audio_out, SYNTH_TONE *tp, uint32_t n, NOISE_READER *np, double w) {
+   	if (tp == NULL && np == NULL) {
+   		return audio_write_silence(audio_out, n) == n ? 0 : EOF;
+   	}
+   	while (n > 0) {
+   		uint32_t chunk = n < SAMPLE_BUF_SIZE ? n : SAMPLE_BUF_SIZE;
+   		if (np != NULL) {
+   			//noise samples, then zeros once the noise runs out
+   			noise_read(np, sample_buf, chunk);
+   			synth_tone_mix(tp, sample_buf, chunk, w);
+   		}
+   		else {
+   			synth_tone_render(tp, sample_buf, chunk);
+   		}
+   		if (audio_write_samples(audio_out, sample_buf, chunk) != chunk) {
+   			return EOF;
+   		}
+   		n -= chunk;
+   	}
+   	return 0;
+}
+
 int dtmf_generate(FILE *events_in, FILE *audio_out, uint32_t length) {
-   	int32_t start;
-   	int32_t end;
-   	char symbol;
-   	int c;
-   	double row;
-   	double column;
-   	int16_t sample;
-   	int16_t noise_sample;
+   	SYNTH_EVENT current = { 0, 0, 0, 0 }; //the event most recently taken
+   	SYNTH_TONE tone; //oscillators for the current DTMF tone
    	double w;
-   	double fr; //frequency row for dtmf
-   	double fc; //frequency column for dtmf
-   	FILE *fp;
+   	NOISE_READER noise;
+   	NOISE_READER *np = NULL;
    	if (noise_file != NULL) {
-   		fp = fopen(noise_file, "r");
-   		for (int i = 0; i < 24; i++){
-   			fgetc(fp);
+   		//the noise is read ahead by another thread while the tones are mixed
+   		if (noise_open(&noise, noise_file, noise_loop) == EOF) {
+   			return EOF;
    		}
+   		np = &noise;
    	}
+   	w = synth_noise_weight(noise_level); //weight of noise in each mixed sample
    	//Set default values for header struct
    	AUDIO_HEADER hp;
    	hp.magic_number = AUDIO_MAGIC;
@@ -94,337 +121,73 @@ int dtmf_generate(FILE *events_in, FILE *audio_out, uint32_t length) {
    	hp.encoding = PCM16_ENCODING;
    	hp.sample_rate = AUDIO_FRAME_RATE;
    	hp.channels = AUDIO_CHANNELS;
-   	audio_write_header(audio_out, &hp);
-   	for (int i = 0; i < length; i++){
-   		if (i >= end) {
-   			//Parse one dtmf event
-        start = 0;
-        end = 0;
-        c = 0;
-   			if ((c = fgetc(events_in)) == EOF){
-          end = 0;
-          goto Line;
-        } //convert char into int
-        c = c - 48;
-   			while (c != '\t' - 48){
-   				start = start * 10 + c;
-   				if ((c = fgetc(events_in)) == EOF){
-            end = 0;
-            goto Line;
-          }
-          c = c - 48;
-   			}
-   			if (start < end) {
-   				return EOF;
-   			}
-   			if ((c = fgetc(events_in)) == EOF) {
-          end = 0;
-          goto Line;
-        }
-        c = c - 48;
-   			while (c != '\t' - 48){
-   				end = end * 10 + c;
-   				if ((c = fgetc(events_in)) == EOF){
-            end = 0;
-            break;
-          }
-          c = c - 48;
+   	int ret = audio_write_header(audio_out, &hp);
+   	uint32_t i = 0;
+   	while (i < length && ret == 0) {
+   		uint32_t span;
+   		int on = 0;
+   		if (i >= current.end) {
+   			//an event is taken only once the previous one is over, and there
+   			//is silence after the last one
+   			int got = synth_read_event(events_in, &current);
+   			if (got == EOF) {
+   				ret = EOF;
+   				break;
    			}
-   			if (start > end){
-   				return EOF;
+   			if (got == 0) {
+   				current.start = length;
+   				current.end = length;
    			}
-        symbol = fgetc(events_in); //find symbol in dtmf table
-        fgetc(events_in); //eat newline character
    		}
-      Line:
-   		if (i >= start && i < end){ //if between audio range
-   			switch (symbol) {
-   				case('1'):
-   					fr = 697;
-   					fc = 1209;
-   					break;
-   				case('2'):
-   					fr = 697;
-   					fc = 1336;
-   					break;
-   				case('3'):
-   					fr = 697;
-   					fc = 1477;
-   					break;
-   				case('A'):
-   					fr = 697;
-   					fc = 1633;
-   					break;
-   				case('4'):
-   					fr = 770;
-   					fc = 1209;
-   					break;
-   				case('5'):
-   					fr = 770;
-   					fc = 1336;
-   					break;
-   				case('6'):
-   					fr = 770;
-   					fc = 1477;
-   					break;
-   				case('B'):
-   					fr = 770;
-   					fc = 1633;
-   					break;
-   				case('7'):
-   					fr = 852;
-   					fc = 1209;
-   					break;
-   				case('8'):
-   					fr = 852;
-   					fc = 1336;
-   					break;
-   				case('9'):
-   					fr = 852;
-   					fc = 1477;
-   					break;
-   				case('C'):
-   					fr = 852;
-   					fc = 1633;
-   					break;
-   				case('*'):
-   					fr = 941;
-   					fc = 1209;
-   					break;
-   				case('0'):
-   					fr = 941;
-   					fc = 1336;
-   					break;
-   				case('#'):
-   					fr = 941;
-   					fc = 1477;
-   					break;
-   				case('D'):
-   					fr = 941;
-   					fc = 1633;
-   					break;
-   				default:
-   					return EOF;
-   			}
-   			row = cos(2.0 * M_PI * fr * (double)i / (double)AUDIO_FRAME_RATE);
-   			column = cos(2.0 * M_PI * fc * (double)i / (double)AUDIO_FRAME_RATE);
-   			sample = (int16_t)(((0.5 * row) + (0.5 * column)) * INT16_MAX);
-   		}
-   		else {
-   			sample = 0;
+   		if (i >= current.start && i < current.end) {
+   			//the tone, up to the end of the event
+   			on = 1;
+   			span = (current.end < length ? current.end : length) - i;
+   			synth_tone_init(&tone, current.row, current.col, i);
    		}
-   		//synthesize noise sample from noise_file
-   		if (noise_file == NULL) {
-   			audio_write_sample(audio_out, sample);
+   		else if (i < current.start) {
+   			//silence, up to the start of the event
+   			span = (current.start < length ? current.start : length) - i;
    		}
    		else {
-   			if (audio_read_sample(fp, &noise_sample) == EOF) {
-   				noise_sample = 0;
-   			}
-   			w = (pow(10,noise_level/10.0))/(1+pow(10,noise_level/10.0));
-   			sample = ((w * noise_sample) + ((1-w) * sample));
-   			audio_write_sample(audio_out, sample);
+   			//an event that was over before it was taken is worth one sample of silence
+   			span = 1;
    		}
+   		ret = generate_span(audio_out, on ? &tone : NULL, span, np, w);
+   		i += span;
+   	}
+   	if (np != NULL) {
+   		noise_close(np);
    	}
-    return 0;
+    return ret;
 }
 
-
-/**
- * DTMF detection main function.
- * This function first reads and validates an audio header from the specified input stream.
- * The value in the data size field of the header is ignored, as is any annotation data that
- * might occur after the header.
- *
- * This function then reads audio sample data from the input stream, partititions the audio samples
- * into successive blocks of block_size samples, and for each block determines whether or not
- * a DTMF tone is present in that block.  When a DTMF tone is detected in a block, the starting index
- * of that block is recorded as the beginning of a "DTMF event".  As long as the same DTMF tone is
- * present in subsequent blocks, the duration of the current DTMF event is extended.  As soon as a
- * block is encountered in which the same DTMF tone is not present, either because no DTMF tone is
- * present in that block or a different tone is present, then the starting index of that block
- * is recorded as the ending index of the current DTMF event.  If the duration of the now-completed
- * DTMF event is greater than or equal to MIN_DTMF_DURATION, then a line of text representing
- * this DTMF event in tab-separated format is emitted to the output stream. If the duration of the
- * DTMF event is less that MIN_DTMF_DURATION, then the event is discarded and nothing is emitted
- * to the output stream.  When the end of audio input is reached, then the total number of samples
- * read is used as the ending index of any current DTMF event and this final event is emitted
- * if its length is at least MIN_DTMF_DURATION.
- *
- *   @param audio_in  Input stream from which to read audio header and sample data.
- *   @param events_out  Output stream to which DTMF events are to be written.
- *   @return 0  If reading of audio and writing of DTMF events is sucessful, EOF otherwise.
- */
 int dtmf_detect(FILE *audio_in, FILE *events_out) {
-	  int rowInd;
-	  int columnInd;
-	  int start;
-	  int end;
-	  int currIndex = 0;
-	  double maxRow;
-	  double maxColumn;
-	  char symbol;
-    AUDIO_HEADER header;
-    audio_read_header(audio_in, &header);
-    uint32_t N = block_size;
-    double k0 = N * 697.0 / 8000.0;
-    double k1 = N * 770.0 / 8000.0;
-    double k2 = N * 852.0 / 8000.0;
-    double k3 = N * 941.0 / 8000.0;
-    double k4 = N * 1209.0 / 8000.0;
-    double k5 = N * 1336.0 / 8000.0;
-    double k6 = N * 1477.0 / 8000.0;
-    double k7 = N * 1633.0 / 8000.0;
-    GOERTZEL_STATE *g0, *g1, *g2, *g3, *g4, *g5, *g6, *g7;
-    double y0, y1, y2, y3, y4, y5, y6, y7;
-    g0 = goertzel_state;
-    g1 = goertzel_state + 1;
-    g2 = goertzel_state + 2;
-    g3 = goertzel_state + 3;
-    g4 = goertzel_state + 4;
-    g5 = goertzel_state + 5;
-    g6 = goertzel_state + 6;
-    g7 = goertzel_state + 7;
-    int failure = 0;
-    while (failure == 0){
-    	goertzel_init(g0, N, k0);
-    	goertzel_init(g1, N, k1);
-    	goertzel_init(g2, N, k2);
-    	goertzel_init(g3, N, k3);
-    	goertzel_init(g4, N, k4);
-    	goertzel_init(g5, N, k5);
-    	goertzel_init(g6, N, k6);
-    	goertzel_init(g7, N, k7);
-    	double x;
-    	int16_t y = 0;
-    	start = currIndex;
-    	for (int i = 0; i <= N - 2; i++){
-        	if (audio_read_sample(audio_in, &y) == EOF) {
-        		failure = -1;
-        		N = i + 1;
-        		break;
-        	}
-        	x = (double)y / INT16_MAX;
-        	goertzel_step(g0, x);
-        	goertzel_step(g1, x);
-        	goertzel_step(g2, x);
-        	goertzel_step(g3, x);
-        	goertzel_step(g4, x);
-        	goertzel_step(g5, x);
-        	goertzel_step(g6, x);
-        	goertzel_step(g7, x);
-        	currIndex++; //increment index in audio_in
-    	}
-    	if (audio_read_sample(audio_in, &y) == EOF){
-    		failure = -1;
-    		if ((N/8.0) < MIN_DTMF_DURATION) {
-    			break;
-    		}
-    	}
-    	x = (double)y / INT16_MAX;
-    	y0 = goertzel_strength(g0, x);
-    	y1 = goertzel_strength(g1, x);
-    	y2 = goertzel_strength(g2, x);
-    	y3 = goertzel_strength(g3, x);
-    	y4 = goertzel_strength(g4, x);
-    	y5 = goertzel_strength(g5, x);
-    	y6 = goertzel_strength(g6, x);
-    	y7 = goertzel_strength(g7, x);
-    	currIndex++;
-    	end = currIndex;
-    	//find the max row and column frequencies
-    	maxRow = 0;
-    	maxColumn = 0;
-    	if (y0 >= maxRow){
-    		maxRow = y0;
-    	}
-    	if (y1 >= maxRow){
-    		maxRow = y1;
-    	}
-    	if (y2 >= maxRow){
-    		maxRow = y2;
-    	}
-    	if (y3 >= maxRow){
-    		maxRow = y3;
-    	}
-    	if (y4 >= maxColumn) {
-    		maxColumn = y4;
-    	}
-    	if (y5 >= maxColumn){
-    		maxColumn = y5;
-    	}
-    	if (y6 >= maxColumn){
-    		maxColumn = y6;
-    	}
-    	if (y7 >= maxColumn){
-    		maxColumn = y7;
-    	}
-    	//check if minimum of -20dB is met
-    	if ((maxRow + maxColumn) < MINUS_20DB) {
-    		continue; //do not write anything
-    	}
-    	//check if twist between -4dB and 4dB
-    	if ((maxRow/maxColumn) > FOUR_DB || (maxColumn/maxRow) > FOUR_DB){
-    		continue; //do not write anything
-    	}
-    	if ((maxRow/y0) < SIX_DB && (maxRow/y0) != 1) {
-    		continue;
-    	}
-    	if ((maxRow/y1) < SIX_DB && (maxRow/y1) != 1) {
-    		continue;
-    	}
-    	if ((maxRow/y2) < SIX_DB && (maxRow/y2) != 1) {
-    		continue;
-    	}
-    	if ((maxRow/y3) < SIX_DB && (maxRow/y3) != 1) {
-    		continue;
-    	}
-		  if ((maxColumn/y4) < SIX_DB && (maxColumn != y4)) {
-    		continue;
-    	}
-    	if ((maxColumn/y5) < SIX_DB && (maxColumn != y5)) {
-    		continue;
-    	}
-    	if ((maxColumn/y6) < SIX_DB && (maxColumn != y6)) {
-    		continue;
-    	}
-    	if ((maxColumn/y7) < SIX_DB && (maxColumn != y7)) {
-    		continue;
-    	}
-
-    	if (maxRow == y0) {
-    		rowInd = 0;
-    	}
-    	else if(maxRow == y1) {
-    		rowInd = 1;
-    	}
-    	else if(maxRow == y2) {
-    		rowInd = 2;
-    	}
-    	else if(maxRow == y3) {
-    		rowInd = 3;
-    	}
-    	if (maxColumn == y4) {
-    		columnInd = 0;
-    	}
-    	else if (maxColumn == y5) {
-    		columnInd = 1;
-    	}
-    	else if (maxColumn == y6) {
-    		columnInd = 2;
-    	}
-    	else if (maxColumn == y7) {
-    		columnInd = 3;
-    	}
-    	symbol = *(*(dtmf_symbol_names + rowInd) + columnInd);
-    	fprintf(events_out, "%d", start);
-    	fputc('\t', events_out);
-    	fprintf(events_out, "%d", end);
-    	fputc('\t', events_out);
-    	fputc(symbol, events_out);
-    	fputc('\n', events_out);
-	}
-	return 0; //success
+    //the filter coefficients depend only on the block size and the families
+    TONE_SET set;
+    if (tone_set_parse(&set, tone_families != NULL ? tone_families : "dtmf") == -1
+	|| tone_set_bank(&set, block_size, AUDIO_FRAME_RATE) == -1) {
+    	return EOF;
+    }
+    if (stream_mode) {
+    	return dtmf_detect_stream(audio_in, events_out, &set.bank, hop_size);
+    }
+    if (batch_count > 0) {
+    	return dtmf_detect_batch(batch_paths, batch_count, events_out, &set, num_jobs);
+    }
+    if (telemetry_file == NULL) {
+    	return dtmf_detect_file(audio_in, events_out, &set, num_jobs, NULL, NULL);
+    }
+    //the strengths of every block also go to the telemetry file
+    FILE *tp = fopen(telemetry_file, "w");
+    if (tp == NULL) {
+    	return EOF;
+    }
+    int ret = dtmf_detect_file(audio_in, events_out, &set, num_jobs, NULL, tp);
+    if (fclose(tp) == EOF) {
+    	ret = EOF;
+    }
+    return ret;
 }
 
 /**
@@ -434,9 +197,11 @@ int dtmf_detect(FILE *audio_in, FILE *events_out) {
  * Upon successful return, the operation mode of the program (help, generate,
  * or detect) will be recorded in the global variable `global_options`,
  * where it will be accessible elsewhere in the program.
- * Global variables `audio_samples`, `noise file`, `noise_level`, and `block_size`
- * will also be set, either to values derived from specified `-t`, `-n`, `-l` and `-b`
- * options, or else to their default values.
+ * Global variables `audio_samples`, `noise file`, `noise_level`, `noise_loop`, `block_size`,
+ * and `num_jobs` will also be set, either to values derived from specified `-t`, `-n`, `-l`,
+ * `-L`, `-b`, and `-j` options, or else to their default values.  In detect mode, any
+ * arguments following the options are recorded in `batch_paths` and `batch_count`, and
+ * `telemetry_file` and `tone_families` are set by the `-T` and `-F` options.
  *
  * @param argc The number of arguments passed to the program from the CLI.
  * @param argv The argument strings passed to the program from the CLI.
@@ -466,6 +231,7 @@ int validargs(int argc, char **argv) {
       audio_samples = AUDIO_FRAME_RATE; //default audio sample value
       noise_file = NULL; //default noise_file (NULL)
       noise_level = 0; //default noise level value
+      noise_loop = 0; //default to silence once the noise runs out
 			for (argInd = 2; argInd < argc; argInd++) {
 
 				str = *(argv + argInd); //access string in array
@@ -499,6 +265,9 @@ int validargs(int argc, char **argv) {
 							return -1;
 						}
 					}
+					else if (*(str + 1) == 'L' && *(str + 2) == '\0') {
+						noise_loop = 1; //repeat the noise file for the whole output
+					}
 					else {
 						return  -1;
 					}
@@ -509,6 +278,13 @@ int validargs(int argc, char **argv) {
 		else if (*(str + 1) == 'd'){
 			global_options = DETECT_OPTION;
       block_size = DEFAULT_BLOCK_SIZE; //default block size value
+      num_jobs = 1; //default to serial detection
+      batch_paths = NULL; //default to reading standard input
+      batch_count = 0;
+      stream_mode = 0; //default to whole-block detection
+      hop_size = 0; //default to the block size
+      telemetry_file = NULL; //default to no telemetry
+      tone_families = NULL; //default to DTMF alone
 			for (argInd = 2; argInd < argc; argInd++) {
 
 				str = *(argv + argInd); //access string in array
@@ -525,11 +301,74 @@ int validargs(int argc, char **argv) {
 							return -1;
 						}
 					}
+					else if (*(str + 1) == 's' && *(str + 2) == '\0') {
+						stream_mode = 1;
+					}
+					else if (*(str + 1) == 'H' && *(str + 2) == '\0') {
+						argInd++; //move to hop size parameter
+						str = *(argv + argInd);
+						int para = stringToInt(str);
+						if (para >= 1 && para <= 1000) { //check if between [1, 1000]
+							hop_size = para;
+						}
+						else {
+							return -1;
+						}
+					}
+					else if (*(str + 1) == 'T' && *(str + 2) == '\0') {
+						argInd++; //move to telemetry file parameter
+						str = *(argv + argInd);
+						if (str == NULL) {
+							return -1;
+						}
+						telemetry_file = str;
+					}
+					else if (*(str + 1) == 'F' && *(str + 2) == '\0') {
+						argInd++; //move to tone families parameter
+						str = *(argv + argInd);
+						TONE_SET set;
+						if (str == NULL || tone_set_parse(&set, str) == -1) {
+							return -1;
+						}
+						tone_families = str;
+					}
+					else if (*(str + 1) == 'j' && *(str + 2) == '\0') {
+						argInd++; //move to number of jobs parameter
+						str = *(argv + argInd);
+						int para = stringToInt(str);
+						if (para >= 1 && para <= MAX_DETECT_JOBS) { //check if between [1, MAX_DETECT_JOBS]
+							num_jobs = para;
+						}
+						else {
+							return -1;
+						}
+					}
 				}
 				else {
-					return -1;
+					//the remaining arguments name the files of a batch
+					batch_paths = argv + argInd;
+					batch_count = argc - argInd;
+					break;
 				}
 			}
+			//a hop only applies to streaming, and cannot exceed the window
+			if (hop_size == 0) {
+				hop_size = block_size;
+			}
+			else if (!stream_mode || hop_size > block_size) {
+				return -1;
+			}
+			if (stream_mode && batch_count > 0) {
+				return -1;
+			}
+			//telemetry is recorded for a single input analyzed in whole blocks
+			if (telemetry_file != NULL && (stream_mode || batch_count > 0)) {
+				return -1;
+			}
+			//other families are detected in whole blocks, and have no telemetry
+			if (tone_families != NULL && (stream_mode || telemetry_file != NULL)) {
+				return -1;
+			}
 		}
 	}
 	else {
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BANK_X86
+#endif
+
+#include "audio.h"
+#include "audio_io.h"
+#include "debug.h"
+#include "goertzel_bank.h"
+#include "goertzel_fixed.h"
+
+#ifndef GOERTZEL_FIXED
+/*
+ * Samples are converted to doubles a chunk at a time, so that each group of
+ * filters can then make a tight pass over the chunk with its state held in
+ * registers.  The chunk is small enough to stay in L1 cache.
+ */
+#define BANK_CHUNK 256
+
+/*
+ * Advance one group of GOERTZEL_BANK_GROUP filters over n scaled samples.
+ * Every variant evaluates s0 = (x + B*s1) - s2 in the same order as
+ * goertzel_step, so that all of them give bit-identical results.
+ * Unaligned loads are used, since a bank may be embedded in heap-allocated
+ * structures with only the default malloc alignment.
+ */
+typedef void (*bank_kernel)(const double *B, double *s1, double *s2, const double *xs, size_t n);
+
+static void bank_kernel_scalar(const double *B, double *s1, double *s2, const double *xs, size_t n) {
+    double b[GOERTZEL_BANK_GROUP], t1[GOERTZEL_BANK_GROUP], t2[GOERTZEL_BANK_GROUP];
+    for (int j = 0; j < GOERTZEL_BANK_GROUP; j++) {
+        b[j] = B[j];
+        t1[j] = s1[j];
+        t2[j] = s2[j];
+    }
+    for (size_t i = 0; i < n; i++) {
+        double x = xs[i];
+        for (int j = 0; j < GOERTZEL_BANK_GROUP; j++) {
+            double s0 = x + b[j] * t1[j] - t2[j];
+            t2[j] = t1[j];
+            t1[j] = s0;
+        }
+    }
+    for (int j = 0; j < GOERTZEL_BANK_GROUP; j++) {
+        s1[j] = t1[j];
+        s2[j] = t2[j];
+    }
+}
+
+#ifdef BANK_X86
+static void bank_kernel_sse2(const double *B, double *s1, double *s2, const double *xs, size_t n) {
+    __m128d b0 = _mm_loadu_pd(B), b1 = _mm_loadu_pd(B + 2);
+    __m128d b2 = _mm_loadu_pd(B + 4), b3 = _mm_loadu_pd(B + 6);
+    __m128d p0 = _mm_loadu_pd(s1), p1 = _mm_loadu_pd(s1 + 2);
+    __m128d p2 = _mm_loadu_pd(s1 + 4), p3 = _mm_loadu_pd(s1 + 6);
+    __m128d q0 = _mm_loadu_pd(s2), q1 = _mm_loadu_pd(s2 + 2);
+    __m128d q2 = _mm_loadu_pd(s2 + 4), q3 = _mm_loadu_pd(s2 + 6);
+    for (size_t i = 0; i < n; i++) {
+        __m128d x = _mm_set1_pd(xs[i]);
+        __m128d r0 = _mm_sub_pd(_mm_add_pd(x, _mm_mul_pd(b0, p0)), q0);
+        __m128d r1 = _mm_sub_pd(_mm_add_pd(x, _mm_mul_pd(b1, p1)), q1);
+        __m128d r2 = _mm_sub_pd(_mm_add_pd(x, _mm_mul_pd(b2, p2)), q2);
+        __m128d r3 = _mm_sub_pd(_mm_add_pd(x, _mm_mul_pd(b3, p3)), q3);
+        q0 = p0; q1 = p1; q2 = p2; q3 = p3;
+        p0 = r0; p1 = r1; p2 = r2; p3 = r3;
+    }
+    _mm_storeu_pd(s1, p0); _mm_storeu_pd(s1 + 2, p1);
+    _mm_storeu_pd(s1 + 4, p2); _mm_storeu_pd(s1 + 6, p3);
+    _mm_storeu_pd(s2, q0); _mm_storeu_pd(s2 + 2, q1);
+    _mm_storeu_pd(s2 + 4, q2); _mm_storeu_pd(s2 + 6, q3);
+}
+
+__attribute__((target("avx2")))
+static void bank_kernel_avx2(const double *B, double *s1, double *s2, const double *xs, size_t n) {
+    __m256d b0 = _mm256_loadu_pd(B), b1 = _mm256_loadu_pd(B + 4);
+    __m256d p0 = _mm256_loadu_pd(s1), p1 = _mm256_loadu_pd(s1 + 4);
+    __m256d q0 = _mm256_loadu_pd(s2), q1 = _mm256_loadu_pd(s2 + 4);
+    for (size_t i = 0; i < n; i++) {
+        __m256d x = _mm256_broadcast_sd(xs + i);
+        __m256d r0 = _mm256_sub_pd(_mm256_add_pd(x, _mm256_mul_pd(b0, p0)), q0);
+        __m256d r1 = _mm256_sub_pd(_mm256_add_pd(x, _mm256_mul_pd(b1, p1)), q1);
+        q0 = p0; q1 = p1;
+        p0 = r0; p1 = r1;
+    }
+    _mm256_storeu_pd(s1, p0); _mm256_storeu_pd(s1 + 4, p1);
+    _mm256_storeu_pd(s2, q0); _mm256_storeu_pd(s2 + 4, q1);
+}
+#endif
+
+/* Kernel selected for this CPU, chosen on first use. */
+static bank_kernel kernel;
+
+static bank_kernel bank_select_kernel(void) {
+#ifdef BANK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        debug("Goertzel bank using AVX2");
+        return bank_kernel_avx2;
+    }
+    debug("Goertzel bank using SSE2");
+    return bank_kernel_sse2;
+#else
+    return bank_kernel_scalar;
+#endif
+}
+#endif
+
+int goertzel_bank_init(GOERTZEL_BANK *bp, uint32_t N, const int *freqs, int size, double rate) {
+    if (size < 1 || size > GOERTZEL_BANK_MAX) {
+        return -1;
+    }
+#ifndef GOERTZEL_FIXED
+    if (kernel == NULL) {
+        kernel = bank_select_kernel();
+    }
+#endif
+    bp->N = N;
+    bp->size = size;
+    bp->rate = rate;
+    bp->N2 = pow(N,2);
+    bp->width = (size + GOERTZEL_BANK_GROUP - 1) / GOERTZEL_BANK_GROUP * GOERTZEL_BANK_GROUP;
+    for (int j = 0; j < GOERTZEL_BANK_MAX; j++) {
+        //same expressions as goertzel_init, so the coefficients are identical
+        bp->freqs[j] = j < size ? freqs[j] : 0;
+        bp->k[j] = j < size ? N * (double)freqs[j] / rate : 0;
+        bp->A[j] = 2 * M_PI * (bp->k[j]/N);
+        bp->B[j] = j < size ? 2 * cos(bp->A[j]) : 0;
+        bp->C[j] = cos(bp->A[j]);
+        bp->y[j] = 0;
+#ifdef GOERTZEL_FIXED
+        GOERTZEL_FIXED_STATE g;
+        goertzel_fixed_init(&g, N, bp->k[j]);
+        bp->Bq[j] = j < size ? g.B : 0;
+        if (j < size && !goertzel_fixed_fits(N, bp->k[j])) {
+            return -1;
+        }
+#endif
+    }
+    goertzel_bank_reset(bp);
+    return 0;
+}
+
+int goertzel_bank_copy(GOERTZEL_BANK *bp, const GOERTZEL_BANK *proto, double rate) {
+    if (rate == proto->rate) {
+        *bp = *proto;
+        return 0;
+    }
+    return goertzel_bank_init(bp, proto->N, proto->freqs, proto->size, rate);
+}
+
+void goertzel_bank_reset(GOERTZEL_BANK *bp) {
+    for (int j = 0; j < GOERTZEL_BANK_MAX; j++) {
+        bp->s1[j] = 0;
+        bp->s2[j] = 0;
+    }
+}
+
+#ifdef GOERTZEL_FIXED
+/*
+ * Each filter makes its own pass over the samples, with its state in registers.
+ * The samples are used as they are, so no conversion pass is needed.
+ */
+void goertzel_bank_run(GOERTZEL_BANK *bp, const int16_t *x, size_t n) {
+    for (int j = 0; j < bp->size; j++) {
+        int32_t B = bp->Bq[j], s1 = bp->s1[j], s2 = bp->s2[j];
+        for (size_t i = 0; i < n; i++) {
+            int32_t s0 = goertzel_fixed_iterate(B, s1, s2, x[i]);
+            s2 = s1;
+            s1 = s0;
+        }
+        bp->s1[j] = s1;
+        bp->s2[j] = s2;
+    }
+}
+
+void goertzel_bank_run_be(GOERTZEL_BANK *bp, const uint8_t *x, size_t n, uint32_t stride) {
+    for (int j = 0; j < bp->size; j++) {
+        int32_t B = bp->Bq[j], s1 = bp->s1[j], s2 = bp->s2[j];
+        for (size_t i = 0; i < n; i++) {
+            int32_t s0 = goertzel_fixed_iterate(B, s1, s2, audio_decode_sample(x + 2*i*stride));
+            s2 = s1;
+            s1 = s0;
+        }
+        bp->s1[j] = s1;
+        bp->s2[j] = s2;
+    }
+}
+
+void goertzel_bank_strength(GOERTZEL_BANK *bp, int16_t x) {
+    for (int j = 0; j < bp->size; j++) {
+        int32_t s0 = goertzel_fixed_iterate(bp->Bq[j], bp->s1[j], bp->s2[j], x);
+        bp->y[j] = goertzel_fixed_energy(s0, bp->s1[j], bp->C[j], bp->N2);
+    }
+}
+#else
+static void bank_run_chunk(GOERTZEL_BANK *bp, const double *xs, size_t n) {
+    for (int j = 0; j < bp->width; j += GOERTZEL_BANK_GROUP) {
+        kernel(bp->B + j, bp->s1 + j, bp->s2 + j, xs, n);
+    }
+}
+
+void goertzel_bank_run(GOERTZEL_BANK *bp, const int16_t *x, size_t n) {
+    double xs[BANK_CHUNK];
+    while (n > 0) {
+        size_t m = n < BANK_CHUNK ? n : BANK_CHUNK;
+        for (size_t i = 0; i < m; i++) {
+            xs[i] = (double)x[i] / INT16_MAX;
+        }
+        bank_run_chunk(bp, xs, m);
+        x += m;
+        n -= m;
+    }
+}
+
+void goertzel_bank_run_be(GOERTZEL_BANK *bp, const uint8_t *x, size_t n, uint32_t stride) {
+    double xs[BANK_CHUNK];
+    while (n > 0) {
+        size_t m = n < BANK_CHUNK ? n : BANK_CHUNK;
+        for (size_t i = 0; i < m; i++) {
+            xs[i] = (double)audio_decode_sample(x + 2*i*stride) / INT16_MAX;
+        }
+        bank_run_chunk(bp, xs, m);
+        x += 2 * m * stride;
+        n -= m;
+    }
+}
+
+void goertzel_bank_strength(GOERTZEL_BANK *bp, int16_t last) {
+    double x = (double)last / INT16_MAX;
+    for (int j = 0; j < bp->size; j++) {
+        //final iteration and strength exactly as in goertzel_strength
+        double s0 = x + bp->B[j] * bp->s1[j] - bp->s2[j];
+        double s1 = bp->s1[j];
+        bp->y[j] = (double)(2 * (pow(s0,2) + pow(s1,2) - 2*(s0 * s1 * bp->C[j]))) / bp->N2;
+    }
+}
+#endif
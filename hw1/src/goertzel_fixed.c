@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include <math.h>
+
+#include "debug.h"
+#include "goertzel_fixed.h"
+
+/* goertzel_fixed_coefficient - 2cos(A) in Q30, kept within 32 bits */
+static int32_t goertzel_fixed_coefficient(double A) {
+    double b = ldexp(2 * cos(A), GOERTZEL_FIXED_Q);
+    if (b >= INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (b <= INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (int32_t)lrint(b);
+}
+
+int goertzel_fixed_fits(uint32_t N, double k) {
+    double gain = fabs(sin(2 * M_PI * (k/N)));
+    gain = gain * N < 1 ? N : 1 / gain;
+    //allow a little for the rounding at each step
+    return (double)N * INT16_MAX * gain + N < INT32_MAX;
+}
+
+void goertzel_fixed_init(GOERTZEL_FIXED_STATE *gp, uint32_t N, double k) {
+    (*gp).N = N;
+    (*gp).k = k;
+    (*gp).A = 2 * M_PI * (k/N);
+    (*gp).B = goertzel_fixed_coefficient((*gp).A);
+    (*gp).s0 = 0;
+    (*gp).s1 = 0;
+    (*gp).s2 = 0;
+}
+
+void goertzel_fixed_step(GOERTZEL_FIXED_STATE *gp, int16_t x) {
+    (*gp).s0 = goertzel_fixed_iterate((*gp).B, (*gp).s1, (*gp).s2, x);
+    (*gp).s2 = (*gp).s1;
+    (*gp).s1 = (*gp).s0;
+}
+
+double goertzel_fixed_strength(GOERTZEL_FIXED_STATE *gp, int16_t x) {
+    (*gp).s0 = goertzel_fixed_iterate((*gp).B, (*gp).s1, (*gp).s2, x);
+    return goertzel_fixed_energy((*gp).s0, (*gp).s1, cos((*gp).A), pow((*gp).N,2));
+}
+
+double goertzel_fixed_energy(int32_t s0, int32_t s1, double C, double N2) {
+    double a = (double)s0 / INT16_MAX;
+    double b = (double)s1 / INT16_MAX;
+    return (double)(2 * (pow(a,2) + pow(b,2) - 2*(a * b * C))) / N2;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include "const.h"
+#include "options.h"
 #include "debug.h"
 
 #ifdef _STRING_H
@@ -19,11 +20,11 @@
 int main(int argc, char **argv)
 {
     if (argc <= 1) {
-        USAGE(*argv, EXIT_FAILURE); //no enough arguments
+        DTMF_USAGE(*argv, EXIT_FAILURE); //no enough arguments
     }
     if (validargs(argc, argv) == 0) { //if arguments are valid
         if (global_options == HELP_OPTION){
-            USAGE(*argv, EXIT_SUCCESS);
+            DTMF_USAGE(*argv, EXIT_SUCCESS);
         }
         else if (global_options == GENERATE_OPTION){
             if(dtmf_generate(stdin, stdout, audio_samples) == EOF){
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "audio.h"
+#include "audio_io.h"
+#include "noise.h"
+#include "debug.h"
+
+/*
+ * noise_fill - decode up to NOISE_BLOCK samples into buffer b, starting
+ * again from the first sample at the end of the file if looping.  Returns
+ * the number of samples, which is less than NOISE_BLOCK only at the end
+ * of the noise.
+ */
+static size_t noise_fill(NOISE_READER *np, int b) {
+    size_t frame = (size_t)np->channels * AUDIO_BYTES_PER_SAMPLE;
+    int16_t *out = np->buf[b];
+    size_t have = 0;
+    int rewound = 0; //nonzero once the file has been started again
+    while (have < NOISE_BLOCK) {
+        size_t got = fread(np->raw, frame, NOISE_BLOCK - have, np->in);
+        for (size_t i = 0; i < got; i++) {
+            *(out + have + i) = audio_decode_sample(np->raw + i * frame);
+        }
+        have += got;
+        if (have == NOISE_BLOCK) {
+            break;
+        }
+        //the end of the file (or an error); a file with no samples is not looped
+        if (!np->loop || (rewound && got == 0) || fseeko(np->in, np->data, SEEK_SET) == -1) {
+            break;
+        }
+        rewound = 1;
+        clearerr(np->in);
+    }
+    return have;
+}
+
+/*
+ * noise_thread - fill the two buffers in turn, each as soon as it has
+ * been used up, until the noise ends or the reader is closed.
+ */
+static void *noise_thread(void *arg) {
+    NOISE_READER *np = arg;
+    for (int b = 0; ; b ^= 1) {
+        pthread_mutex_lock(&np->lock);
+        while (np->ready[b] && !np->stop) {
+            pthread_cond_wait(&np->cond, &np->lock);
+        }
+        int stop = np->stop;
+        pthread_mutex_unlock(&np->lock);
+        if (stop) {
+            break;
+        }
+        size_t n = noise_fill(np, b);
+        pthread_mutex_lock(&np->lock);
+        np->fill[b] = n;
+        np->ready[b] = n > 0;
+        np->done = n < NOISE_BLOCK;
+        pthread_cond_broadcast(&np->cond);
+        pthread_mutex_unlock(&np->lock);
+        if (n < NOISE_BLOCK) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int noise_open(NOISE_READER *np, const char *path, int loop) {
+    AUDIO_HEADER header;
+    np->in = fopen(path, "r");
+    if (np->in == NULL) {
+        return EOF;
+    }
+    //the header leaves the stream at data_offset, past any annotation
+    if (audio_read_header(np->in, &header) == EOF) {
+        fclose(np->in);
+        return EOF;
+    }
+    np->channels = header.channels;
+    np->data = header.data_offset;
+    np->loop = loop;
+    np->raw = malloc((size_t)NOISE_BLOCK * header.channels * AUDIO_BYTES_PER_SAMPLE);
+    np->buf[0] = malloc(2 * NOISE_BLOCK * sizeof(int16_t));
+    if (np->raw == NULL || np->buf[0] == NULL) {
+        free(np->raw);
+        free(np->buf[0]);
+        fclose(np->in);
+        return EOF;
+    }
+    np->buf[1] = np->buf[0] + NOISE_BLOCK;
+    np->fill[0] = np->fill[1] = 0;
+    np->ready[0] = np->ready[1] = 0;
+    np->cur = 0;
+    np->held = 0;
+    np->pos = 0;
+    np->end = 0;
+    np->done = 0;
+    np->stop = 0;
+    pthread_mutex_init(&np->lock, NULL);
+    pthread_cond_init(&np->cond, NULL);
+    //without a thread, each buffer is filled when it is needed
+    np->threaded = pthread_create(&np->tid, NULL, noise_thread, np) == 0;
+    if (!np->threaded) {
+        debug("noise: no read-ahead thread, reading synchronously");
+    }
+    return 0;
+}
+
+/*
+ * noise_next - move on to the next buffer of samples, waiting for it to be
+ * filled if need be.  Returns the number of samples in it, which is 0 once
+ * the noise has run out.
+ */
+static size_t noise_next(NOISE_READER *np) {
+    if (np->threaded) {
+        pthread_mutex_lock(&np->lock);
+        if (np->held) {
+            //hand the used buffer back to be filled again
+            np->ready[np->cur] = 0;
+            np->cur ^= 1;
+            np->held = 0;
+            pthread_cond_broadcast(&np->cond);
+        }
+        while (!np->ready[np->cur] && !np->done) {
+            pthread_cond_wait(&np->cond, &np->lock);
+        }
+        np->held = np->ready[np->cur];
+        np->end = np->held ? np->fill[np->cur] : 0;
+        pthread_mutex_unlock(&np->lock);
+    }
+    else {
+        np->end = np->done ? 0 : noise_fill(np, np->cur);
+        np->done = np->end < NOISE_BLOCK;
+    }
+    np->pos = 0;
+    return np->end;
+}
+
+void noise_read(NOISE_READER *np, int16_t *out, size_t n) {
+    while (n > 0) {
+        if (np->pos == np->end && noise_next(np) == 0) {
+            break;
+        }
+        size_t take = np->end - np->pos < n ? np->end - np->pos : n;
+        const int16_t *src = np->buf[np->cur] + np->pos;
+        for (size_t i = 0; i < take; i++) {
+            *(out + i) = *(src + i);
+        }
+        np->pos += take;
+        out += take;
+        n -= take;
+    }
+    //zeros once the noise has run out
+    for (size_t i = 0; i < n; i++) {
+        *(out + i) = 0;
+    }
+}
+
+void noise_close(NOISE_READER *np) {
+    if (np->threaded) {
+        pthread_mutex_lock(&np->lock);
+        np->stop = 1;
+        pthread_cond_broadcast(&np->cond);
+        pthread_mutex_unlock(&np->lock);
+        pthread_join(np->tid, NULL);
+    }
+    pthread_mutex_destroy(&np->lock);
+    pthread_cond_destroy(&np->cond);
+    free(np->raw);
+    free(np->buf[0]);
+    fclose(np->in);
+}
@@ -0,0 +1,13 @@
+#include "options.h"
+
+/*
+ * Definitions of the option globals declared in options.h.
+ */
+int num_jobs;
+char **batch_paths;
+int batch_count;
+int stream_mode;
+int hop_size;
+int noise_loop;
+char *telemetry_file;
+char *tone_families;
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "const.h"
+#include "detect.h"
+#include "debug.h"
+
+/*
+ * State of an open tone run in streaming detection.
+ */
+typedef struct stream_run {
+    int channel;     // Channel number written in records, or -1 for mono audio.
+    int symbol;      // Symbol of the run, or 0 if no run is open.
+    size_t start;    // Index of the first sample of the first window of the run.
+    size_t end;      // Index just past the last window of the run seen so far.
+} STREAM_RUN;
+
+/* stream_record - write one record and push it out immediately */
+static int stream_record(FILE *out, const char *kind, const STREAM_RUN *rp, int with_end) {
+    if (fprintf(out, "%s\t", kind) < 0) {
+        return EOF;
+    }
+    if (rp->channel >= 0 && fprintf(out, "%d\t", rp->channel) < 0) {
+        return EOF;
+    }
+    int ret = with_end ? fprintf(out, "%zu\t%zu\t%c\n", rp->start, rp->end, rp->symbol)
+                       : fprintf(out, "%zu\t%c\n", rp->start, rp->symbol);
+    if (ret < 0 || fflush(out) == EOF) {
+        return EOF;
+    }
+    return 0;
+}
+
+/*
+ * stream_window - analyze the window of N samples ending at the newest
+ * sample in the ring of one channel, and update its run with the outcome.
+ */
+static int stream_window(GOERTZEL_BANK *bp, const int16_t *ring, uint32_t pos, size_t wstart,
+                         STREAM_RUN *rp, FILE *out) {
+    uint32_t N = bp->N;
+    //the oldest sample of the window is at pos; present them in order
+    goertzel_bank_reset(bp);
+    if (pos == 0) {
+        goertzel_bank_run(bp, ring, N - 1);
+    }
+    else {
+        goertzel_bank_run(bp, ring + pos, N - pos);
+        goertzel_bank_run(bp, ring, pos - 1);
+    }
+    goertzel_bank_strength(bp, *(ring + (pos + N - 1) % N));
+    int symbol = dtmf_decide(bp->y);
+    if (rp->symbol != 0 && symbol == rp->symbol) {
+        rp->end = wstart + N;
+        return 0;
+    }
+    if (rp->symbol != 0 && stream_record(out, "end", rp, 1) == EOF) {
+        return EOF;
+    }
+    rp->symbol = symbol;
+    if (symbol != 0) {
+        rp->start = wstart;
+        rp->end = wstart + N;
+        return stream_record(out, "start", rp, 0);
+    }
+    return 0;
+}
+
+int dtmf_detect_stream(FILE *audio_in, FILE *events_out, const GOERTZEL_BANK *proto, uint32_t hop) {
+    //no read-ahead, so that the header leaves the descriptor at the first sample
+    setvbuf(audio_in, NULL, _IONBF, 0);
+    AUDIO_HEADER header;
+    if (audio_read_header(audio_in, &header) == EOF) {
+        return EOF;
+    }
+    GOERTZEL_BANK bank;
+    if (goertzel_bank_copy(&bank, proto, header.sample_rate) == -1) {
+        return EOF;
+    }
+    uint32_t N = bank.N;
+    uint32_t C = header.channels;
+    size_t frame = (size_t)C * AUDIO_BYTES_PER_SAMPLE;
+    int16_t *ring = malloc((size_t)C * N * sizeof(int16_t)); //the most recent N samples, per channel
+    STREAM_RUN *run = malloc(C * sizeof(STREAM_RUN));
+    if (ring == NULL || run == NULL) {
+        free(ring);
+        free(run);
+        return EOF;
+    }
+    for (uint32_t ch = 0; ch < C; ch++) {
+        (run + ch)->channel = C > 1 ? (int)ch : -1;
+        (run + ch)->symbol = 0;
+    }
+    uint8_t bytes[4096];
+    uint32_t pos = 0;              //index in each ring of the next sample
+    size_t total = 0;              //number of frames received
+    size_t next = N;               //value of total at which the next window is complete
+    size_t have = 0;               //bytes in the buffer, including a partial frame
+    int fd = fileno(audio_in);
+    int ret = 0;
+    int err = 0;                   //EOF if the input ended with a read error
+    while (ret == 0) {
+        //take whatever is available, rather than waiting for a whole block
+        ssize_t got = read(fd, bytes + have, sizeof(bytes) - have);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            err = EOF;
+            break;
+        }
+        if (got == 0) {
+            break;
+        }
+        have += got;
+        size_t i;
+        for (i = 0; i + frame <= have && ret == 0; i += frame) {
+            for (uint32_t ch = 0; ch < C; ch++) {
+                *(ring + ch * N + pos) = audio_decode_sample(bytes + i + ch * AUDIO_BYTES_PER_SAMPLE);
+            }
+            pos = (pos + 1) % N;
+            if (++total == next) {
+                for (uint32_t ch = 0; ch < C && ret == 0; ch++) {
+                    ret = stream_window(&bank, ring + ch * N, pos, total - N, run + ch, events_out);
+                }
+                next += hop;
+            }
+        }
+        //keep a trailing partial frame for the next read
+        for (size_t j = i; j < have; j++) {
+            *(bytes + j - i) = *(bytes + j);
+        }
+        have -= i;
+    }
+    //the input has ended, or failed, so any open run ends with its last window
+    for (uint32_t ch = 0; ch < C && ret == 0; ch++) {
+        if ((run + ch)->symbol != 0) {
+            ret = stream_record(events_out, "end", run + ch, 1);
+        }
+    }
+    free(ring);
+    free(run);
+    return ret == 0 ? err : ret;
+}
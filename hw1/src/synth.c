@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "const.h"
+#include "debug.h"
+#include "synth.h"
+
+/* Vector of the values of one quantity in the SYNTH_LANES lanes. */
+typedef double synth_vec __attribute__((vector_size(SYNTH_LANES * sizeof(double))));
+
+#define SYNTH_MIX_CHUNK 1024     // Tone samples rendered at a time for mixing.
+
+/* synth_osc_seed - set an oscillator to the exact phase at a sample index */
+static void synth_osc_seed(SYNTH_OSC *op, uint32_t index) {
+    double phase = 2.0 * M_PI * op->f * (double)index / (double)AUDIO_FRAME_RATE;
+    op->c = cos(phase);
+    op->s = sin(phase);
+}
+
+static void synth_osc_init(SYNTH_OSC *op, double f, uint32_t index) {
+    double w = 2.0 * M_PI * f / (double)AUDIO_FRAME_RATE;
+    op->f = f;
+    op->cw = cos(w);
+    op->sw = sin(w);
+    op->cwl = cos(SYNTH_LANES * w);
+    op->swl = sin(SYNTH_LANES * w);
+    synth_osc_seed(op, index);
+}
+
+/* synth_osc_step - rotate an oscillator on to the next sample */
+static inline void synth_osc_step(SYNTH_OSC *op) {
+    double c = op->c * op->cw - op->s * op->sw;
+    double s = op->s * op->cw + op->c * op->sw;
+    op->c = c;
+    op->s = s;
+}
+
+void synth_tone_init(SYNTH_TONE *tp, double fr, double fc, uint32_t index) {
+    synth_osc_init(&tp->row, fr, index);
+    synth_osc_init(&tp->col, fc, index);
+    tp->index = index;
+}
+
+int16_t synth_tone_next(SYNTH_TONE *tp) {
+    int16_t sample = (int16_t)(((0.5 * tp->row.c) + (0.5 * tp->col.c)) * INT16_MAX);
+    if (++tp->index % SYNTH_RESEED == 0) {
+        synth_osc_seed(&tp->row, tp->index);
+        synth_osc_seed(&tp->col, tp->index);
+    }
+    else {
+        synth_osc_step(&tp->row);
+        synth_osc_step(&tp->col);
+    }
+    return sample;
+}
+
+/*
+ * synth_render_lanes - render groups of SYNTH_LANES samples, with a copy of
+ * each oscillator per lane.  The groups must not extend past the next
+ * reseeding point.
+ */
+static void synth_render_lanes(SYNTH_TONE *tp, int16_t *out, size_t groups) {
+    SYNTH_OSC row = tp->row, col = tp->col;
+    synth_vec rc, rs, cc, cs;
+    //lane j starts j samples ahead
+    for (int j = 0; j < SYNTH_LANES; j++) {
+        rc[j] = row.c;
+        rs[j] = row.s;
+        cc[j] = col.c;
+        cs[j] = col.s;
+        synth_osc_step(&row);
+        synth_osc_step(&col);
+    }
+    double rcw = tp->row.cwl, rsw = tp->row.swl, ccw = tp->col.cwl, csw = tp->col.swl;
+    for (size_t g = 0; g < groups; g++) {
+        synth_vec v = ((0.5 * rc) + (0.5 * cc)) * (double)INT16_MAX;
+        for (int j = 0; j < SYNTH_LANES; j++) {
+            out[g * SYNTH_LANES + j] = (int16_t)v[j];
+        }
+        synth_vec c = rc * rcw - rs * rsw;
+        rs = rs * rcw + rc * rsw;
+        rc = c;
+        c = cc * ccw - cs * csw;
+        cs = cs * ccw + cc * csw;
+        cc = c;
+    }
+    //lane 0 has arrived at the next sample to be generated
+    tp->row.c = rc[0];
+    tp->row.s = rs[0];
+    tp->col.c = cc[0];
+    tp->col.s = cs[0];
+    tp->index += groups * SYNTH_LANES;
+    if (tp->index % SYNTH_RESEED == 0) {
+        synth_osc_seed(&tp->row, tp->index);
+        synth_osc_seed(&tp->col, tp->index);
+    }
+}
+
+void synth_tone_render(SYNTH_TONE *tp, int16_t *out, size_t n) {
+    while (n > 0) {
+        //samples up to the next reseeding point are rendered in lanes
+        size_t seg = SYNTH_RESEED - tp->index % SYNTH_RESEED;
+        if (seg > n) {
+            seg = n;
+        }
+        size_t groups = seg / SYNTH_LANES;
+        if (groups > 1) {
+            synth_render_lanes(tp, out, groups);
+            out += groups * SYNTH_LANES;
+            n -= groups * SYNTH_LANES;
+            seg -= groups * SYNTH_LANES;
+        }
+        for (size_t i = 0; i < seg; i++) {
+            out[i] = synth_tone_next(tp);
+        }
+        out += seg;
+        n -= seg;
+    }
+}
+
+void synth_tone_mix(SYNTH_TONE *tp, int16_t *buf, size_t n, double w) {
+    int16_t tone[SYNTH_MIX_CHUNK];
+    while (n > 0) {
+        size_t m = n < SYNTH_MIX_CHUNK ? n : SYNTH_MIX_CHUNK;
+        if (tp != NULL) {
+            synth_tone_render(tp, tone, m);
+        }
+        for (size_t i = 0; i < m; i++) {
+            int16_t sample = tp != NULL ? tone[i] : 0;
+            buf[i] = ((w * buf[i]) + ((1-w) * sample));
+        }
+        buf += m;
+        n -= m;
+    }
+}
+
+double synth_noise_weight(int level) {
+    return (pow(10,level/10.0))/(1+pow(10,level/10.0));
+}
+
+/*
+ * synth_field - read a decimal field up to the tab that ends it: 1 if the tab
+ * was read, 0 if the input ended first, EOF if the field is not a number
+ */
+static int synth_field(FILE *in, uint32_t *valuep) {
+    uint64_t value = 0;
+    int c;
+    while ((c = getc(in)) != EOF && c != '\t') {
+        if (c < '0' || c > '9' || (value = value * 10 + (c - '0')) > UINT32_MAX) {
+            return EOF;
+        }
+    }
+    *valuep = value;
+    return c == '\t';
+}
+
+/* synth_symbol - look up the frequencies of a DTMF symbol */
+static int synth_symbol(int symbol, SYNTH_EVENT *ep) {
+    for (int r = 0; r < NUM_DTMF_ROW_FREQS; r++) {
+        for (int c = 0; c < NUM_DTMF_COL_FREQS; c++) {
+            if (dtmf_symbol_names[r][c] == symbol) {
+                ep->row = dtmf_freqs[r];
+                ep->col = dtmf_freqs[NUM_DTMF_ROW_FREQS + c];
+                return 0;
+            }
+        }
+    }
+    return EOF;
+}
+
+int synth_read_event(FILE *in, SYNTH_EVENT *ep) {
+    int ret = synth_field(in, &ep->start);
+    if (ret != 1) {
+        //a final partial line is ignored, but not a read error
+        return ret == 0 && !ferror(in) ? 0 : EOF;
+    }
+    int symbol;
+    if (synth_field(in, &ep->end) != 1 || (symbol = getc(in)) == EOF
+        || ep->start > ep->end || synth_symbol(symbol, ep) == EOF) {
+        return EOF;
+    }
+    //skip the newline after the symbol
+    getc(in);
+    return 1;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "const.h"
+#include "detect.h"
+#include "telemetry.h"
+#include "debug.h"
+
+/* telemetry_put - store the low `bytes` bytes of v at p, big-endian */
+static void telemetry_put(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) {
+        *(p + i) = v & 0xff;
+        v >>= 8;
+    }
+}
+
+/* telemetry_get - the big-endian value of `bytes` bytes at p */
+static uint64_t telemetry_get(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v = v << 8 | *(p + i);
+    }
+    return v;
+}
+
+/* the bits of a double, which are written as a 64-bit field */
+typedef union telemetry_double {
+    double d;
+    uint64_t u;
+} TELEMETRY_DOUBLE;
+
+int telemetry_write_header(FILE *out, uint32_t block_size, uint32_t sample_rate, uint32_t channels) {
+    uint8_t bytes[4 * (6 + NUM_DTMF_FREQS)];
+    uint32_t fields[6] = { TELEMETRY_MAGIC, TELEMETRY_VERSION, block_size, sample_rate, channels,
+                           NUM_DTMF_FREQS };
+    for (int i = 0; i < 6; i++) {
+        telemetry_put(bytes + 4 * i, fields[i], 4);
+    }
+    for (int i = 0; i < NUM_DTMF_FREQS; i++) {
+        telemetry_put(bytes + 4 * (6 + i), dtmf_freqs[i], 4);
+    }
+    return fwrite(bytes, sizeof(bytes), 1, out) == 1 ? 0 : EOF;
+}
+
+int telemetry_write_record(FILE *out, uint64_t start, uint32_t frames, uint32_t channel,
+                           int symbol, const double *y) {
+    uint8_t bytes[TELEMETRY_RECORD_SIZE];
+    telemetry_put(bytes, start, 8);
+    telemetry_put(bytes + 8, frames, 4);
+    telemetry_put(bytes + 12, channel, 2);
+    telemetry_put(bytes + 14, symbol, 1);
+    telemetry_put(bytes + 15, 0, 1);
+    for (int i = 0; i < NUM_DTMF_FREQS; i++) {
+        TELEMETRY_DOUBLE v = { .d = y[i] };
+        telemetry_put(bytes + 16 + 8 * i, v.u, 8);
+    }
+    return fwrite(bytes, sizeof(bytes), 1, out) == 1 ? 0 : EOF;
+}
+
+int telemetry_read_header(FILE *in, TELEMETRY_HEADER *hp) {
+    uint8_t bytes[4 * 6];
+    if (fread(bytes, sizeof(bytes), 1, in) != 1) {
+        return EOF;
+    }
+    hp->magic_number = telemetry_get(bytes, 4);
+    hp->version = telemetry_get(bytes + 4, 4);
+    hp->block_size = telemetry_get(bytes + 8, 4);
+    hp->sample_rate = telemetry_get(bytes + 12, 4);
+    hp->channels = telemetry_get(bytes + 16, 4);
+    hp->num_freqs = telemetry_get(bytes + 20, 4);
+    if (hp->magic_number != TELEMETRY_MAGIC || hp->version != TELEMETRY_VERSION
+        || hp->num_freqs != NUM_DTMF_FREQS) {
+        return EOF;
+    }
+    for (int i = 0; i < NUM_DTMF_FREQS; i++) {
+        if (fread(bytes, 4, 1, in) != 1) {
+            return EOF;
+        }
+        hp->freqs[i] = telemetry_get(bytes, 4);
+    }
+    return 0;
+}
+
+int telemetry_read_record(FILE *in, TELEMETRY_RECORD *rp) {
+    uint8_t bytes[TELEMETRY_RECORD_SIZE];
+    if (fread(bytes, sizeof(bytes), 1, in) != 1) {
+        return EOF;
+    }
+    rp->start = telemetry_get(bytes, 8);
+    rp->frames = telemetry_get(bytes + 8, 4);
+    rp->channel = telemetry_get(bytes + 12, 2);
+    rp->symbol = telemetry_get(bytes + 14, 1);
+    for (int i = 0; i < NUM_DTMF_FREQS; i++) {
+        TELEMETRY_DOUBLE v = { .u = telemetry_get(bytes + 16 + 8 * i, 8) };
+        rp->y[i] = v.d;
+    }
+    return 0;
+}
+
+int telemetry_decide(const double *y, const TELEMETRY_LIMITS *lp) {
+    return dtmf_decide_limits(y, lp->level, lp->twist, lp->dominance);
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "const.h"
+#include "detect.h"
+#include "tone.h"
+#include "debug.h"
+
+/* tone_decide_dtmf - the DTMF decision, with the thresholds of const.h */
+static int tone_decide_dtmf(const TONE_FAMILY *fp, const double *y) {
+    return dtmf_decide(y);
+}
+
+/*
+ * The built-in families.  The DTMF frequencies are those of dtmf_freqs; its
+ * symbols are given by dtmf_symbol_names through dtmf_decide.
+ */
+static const TONE_FAMILY builtin_families[] = {
+    { "dtmf", 8, { 697, 770, 852, 941, 1209, 1336, 1477, 1633 }, { { 0 } },
+      MINUS_20DB, FOUR_DB, SIX_DB, tone_decide_dtmf },
+    { "mf", 6, { 700, 900, 1100, 1300, 1500, 1700 },
+      { { 0, '1', '2', '4', '7', 'C' },
+        { 0, 0, '3', '5', '8', 'A' },
+        { 0, 0, 0, '6', '9', 'K' },
+        { 0, 0, 0, 0, '0', 'B' },
+        { 0, 0, 0, 0, 0, 'S' } },
+      MINUS_20DB, SIX_DB, SIX_DB, tone_decide },
+    { "cp", 4, { 350, 440, 480, 620 },
+      { { 0, 'D', 0, 0 },
+        { 0, 0, 'R', 0 },
+        { 0, 0, 0, 'B' } },
+      MINUS_20DB, FOUR_DB, SIX_DB, tone_decide },
+};
+#define NUM_BUILTIN_FAMILIES (sizeof(builtin_families) / sizeof(*builtin_families))
+
+const TONE_FAMILY *tone_family_find(const char *name, size_t len) {
+    for (size_t f = 0; f < NUM_BUILTIN_FAMILIES; f++) {
+        const char *s = builtin_families[f].name;
+        size_t i = 0;
+        while (i < len && *(s + i) != '\0' && *(s + i) == *(name + i)) {
+            i++;
+        }
+        if (i == len && *(s + i) == '\0') {
+            return builtin_families + f;
+        }
+    }
+    return NULL;
+}
+
+int tone_parse_families(const char *list, const TONE_FAMILY **families) {
+    int count = 0;
+    const char *p = list;
+    while (1) {
+        size_t len = 0;
+        while (*(p + len) != ',' && *(p + len) != '\0') {
+            len++;
+        }
+        const TONE_FAMILY *fp = tone_family_find(p, len);
+        if (fp == NULL || count == TONE_MAX_FAMILIES) {
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (*(families + i) == fp) {
+                return -1;
+            }
+        }
+        *(families + count++) = fp;
+        if (*(p + len) == '\0') {
+            return count;
+        }
+        p += len + 1;
+    }
+}
+
+int tone_set_parse(TONE_SET *sp, const char *list) {
+    int count = tone_parse_families(list, sp->families);
+    if (count == -1) {
+        return -1;
+    }
+    sp->count = count;
+    return count;
+}
+
+int tone_set_bank(TONE_SET *sp, uint32_t N, double rate) {
+    int freqs[GOERTZEL_BANK_MAX];
+    int size = 0;
+    for (int f = 0; f < sp->count; f++) {
+        const TONE_FAMILY *fp = sp->families[f];
+        if (size + fp->size > GOERTZEL_BANK_MAX) {
+            return -1;
+        }
+        sp->offset[f] = size;
+        for (int i = 0; i < fp->size; i++) {
+            freqs[size++] = fp->freqs[i];
+        }
+    }
+    sp->named = sp->count > 1 || sp->families[0] != builtin_families;
+    return goertzel_bank_init(&sp->bank, N, freqs, size, rate);
+}
+
+int tone_set_init(TONE_SET *sp, const TONE_FAMILY **families, int count, uint32_t N, double rate) {
+    if (count < 1 || count > TONE_MAX_FAMILIES) {
+        return -1;
+    }
+    for (int f = 0; f < count; f++) {
+        sp->families[f] = *(families + f);
+    }
+    sp->count = count;
+    return tone_set_bank(sp, N, rate);
+}
+
+int tone_decide(const TONE_FAMILY *fp, const double *y) {
+    //the two strongest frequencies, the first of any that are equal
+    int a = 0, b = -1;
+    for (int i = 1; i < fp->size; i++) {
+        if (y[i] > y[a]) {
+            b = a;
+            a = i;
+        }
+        else if (b < 0 || y[i] > y[b]) {
+            b = i;
+        }
+    }
+    double strong = y[a], weak = y[b];
+    int ok = weak >= 0 && strong + weak >= fp->level && strong <= fp->twist * weak;
+    for (int i = 0; i < fp->size && ok; i++) {
+        ok = i == a || i == b || (y[i] >= 0 && weak >= fp->dominance * y[i]);
+    }
+    if (!ok) {
+        return 0;
+    }
+    return a < b ? fp->symbols[a][b] : fp->symbols[b][a];
+}
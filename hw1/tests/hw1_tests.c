@@ -2,7 +2,19 @@
 #include <criterion/logging.h>
 #include <string.h>  // You may use this here in the test cases, but not elsewhere.
 #include <math.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
 #include "const.h"
+#include "options.h"
+#include "audio_io.h"
+#include "goertzel_bank.h"
+#include "goertzel_fixed.h"
+#include "detect.h"
+#include "synth.h"
+#include "noise.h"
+#include "telemetry.h"
+#include "tone.h"
 
 Test(basecode_tests_suite, validargs_help_test) {
     int argc = 2;
@@ -44,6 +56,49 @@ Test(basecode_tests_suite, validargs_detect_test) {
 		 block_size, exp_size);
 }
 
+Test(basecode_tests_suite, validargs_jobs_test) {
+    int argc = 6;
+    char *argv[] = {"bin/dtmf", "-d", "-j", "8", "-b", "50", NULL};
+    int exp_ret = 0;
+    int exp_jobs = 8;
+    int ret = validargs(argc, argv);
+    cr_assert_eq(ret, exp_ret, "Invalid return for valid args.  Got: %d | Expected: %d",
+		 ret, exp_ret);
+    cr_assert_eq(num_jobs, exp_jobs, "Number of jobs not properly set. Got: %d | Expected: %d",
+		 num_jobs, exp_jobs);
+    char *bad_argv[] = {"bin/dtmf", "-d", "-j", "0", NULL};
+    ret = validargs(4, bad_argv);
+    cr_assert_eq(ret, -1, "Invalid return for invalid args.  Got: %d | Expected: %d", ret, -1);
+}
+
+Test(basecode_tests_suite, validargs_batch_test) {
+    int argc = 6;
+    char *argv[] = {"bin/dtmf", "-d", "-j", "4", "a.au", "dir", NULL};
+    int exp_ret = 0;
+    int exp_count = 2;
+    int ret = validargs(argc, argv);
+    cr_assert_eq(ret, exp_ret, "Invalid return for valid args.  Got: %d | Expected: %d",
+		 ret, exp_ret);
+    cr_assert_eq(batch_count, exp_count, "Batch count not properly set. Got: %d | Expected: %d",
+		 batch_count, exp_count);
+    cr_assert_eq(batch_paths, argv + 4, "Batch paths not properly set.");
+}
+
+Test(basecode_tests_suite, validargs_stream_test) {
+    int argc = 7;
+    char *argv[] = {"bin/dtmf", "-d", "-b", "200", "-s", "-H", "50", NULL};
+    int exp_ret = 0;
+    int ret = validargs(argc, argv);
+    cr_assert_eq(ret, exp_ret, "Invalid return for valid args.  Got: %d | Expected: %d",
+		 ret, exp_ret);
+    cr_assert_eq(stream_mode, 1, "Stream mode not properly set.");
+    cr_assert_eq(hop_size, 50, "Hop size not properly set. Got: %d | Expected: %d",
+		 hop_size, 50);
+    char *bad[] = {"bin/dtmf", "-d", "-b", "20", "-s", "-H", "50", NULL};
+    ret = validargs(argc, bad);
+    cr_assert_eq(ret, -1, "Hop larger than the block size was accepted.");
+}
+
 Test(basecode_tests_suite, validargs_error_test) {
     int argc = 4;
     char *argv[] = {"bin/dtmf", "-g", "-b", "10", NULL};
@@ -90,3 +145,646 @@ Test(basecode_tests_suite, goertzel_basic_test) {
     cr_assert((fabs(r1-0.5) < eps), "r1 was %f, should be 0.5", r1);
     cr_assert((fabs(r2) < eps), "r2 was %f, should be 0.0", r2);
 }
+
+Test(basecode_tests_suite, audio_samples_roundtrip_test) {
+    int16_t out[] = {0, 1, -1, INT16_MAX, INT16_MIN, 0x1234, -0x1234};
+    int n = sizeof(out) / sizeof(*out);
+    int16_t in[sizeof(out) / sizeof(*out)];
+    FILE *f = tmpfile();
+    size_t ret = audio_write_samples(f, out, n);
+    cr_assert_eq(ret, n, "Wrong count written.  Got: %zu | Expected: %d", ret, n);
+    rewind(f);
+    unsigned char be[4];
+    fread(be, 1, 4, f);
+    cr_assert(be[2] == 0x00 && be[3] == 0x01, "Sample data was not big-endian");
+    rewind(f);
+    ret = audio_read_samples(f, in, n + 1);
+    cr_assert_eq(ret, n, "Wrong count read.  Got: %zu | Expected: %d", ret, n);
+    for(int i = 0; i < n; i++)
+	cr_assert_eq(in[i], out[i], "Sample %d was %d, should be %d", i, in[i], out[i]);
+    fclose(f);
+}
+
+Test(basecode_tests_suite, audio_header_annotation_test) {
+    AUDIO_HEADER hdr = {AUDIO_MAGIC, AUDIO_DATA_OFFSET + 8, 2, PCM16_ENCODING,
+			AUDIO_FRAME_RATE, AUDIO_CHANNELS};
+    FILE *f = tmpfile();
+    audio_write_header(f, &hdr);
+    fwrite("notes!!", 1, 8, f);
+    audio_write_sample(f, 0x2468);
+    rewind(f);
+    AUDIO_HEADER got;
+    int ret = audio_read_header(f, &got);
+    cr_assert_eq(ret, 0, "Valid header was rejected.  Got: %d", ret);
+    cr_assert_eq(got.data_offset, hdr.data_offset, "Wrong data offset.  Got: %u | Expected: %u",
+		 got.data_offset, hdr.data_offset);
+    int16_t sample;
+    audio_read_sample(f, &sample);
+    cr_assert_eq(sample, 0x2468, "Annotation was not skipped.  Got: %x | Expected: %x",
+		 sample, 0x2468);
+    fclose(f);
+}
+
+Test(basecode_tests_suite, detect_multichannel_test) {
+    //two channels at 16 kHz: '5' on channel 0, then '#' on channel 1
+    int n = 800;
+    AUDIO_HEADER hdr = {AUDIO_MAGIC, AUDIO_DATA_OFFSET, 2 * 2 * 2 * n, PCM16_ENCODING, 16000, 2};
+    FILE *f = tmpfile();
+    audio_write_header(f, &hdr);
+    for(int i = 0; i < 2 * n; i++) {
+	int16_t tone5 = (int16_t)((0.5 * cos(2 * M_PI * 770 * i / 16000.0) + 0.5 * cos(2 * M_PI * 1336 * i / 16000.0)) * INT16_MAX);
+	int16_t toneh = (int16_t)((0.5 * cos(2 * M_PI * 941 * i / 16000.0) + 0.5 * cos(2 * M_PI * 1477 * i / 16000.0)) * INT16_MAX);
+	audio_write_sample(f, i < n ? tone5 : 0);
+	audio_write_sample(f, i < n ? 0 : toneh);
+    }
+    rewind(f);
+    const TONE_FAMILY *dtmf = tone_family_find("dtmf", 4);
+    TONE_SET set;
+    tone_set_init(&set, &dtmf, 1, 400, AUDIO_FRAME_RATE);
+    char *events = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&events, &len);
+    int ret = dtmf_detect_file(f, out, &set, 1, NULL, NULL);
+    fclose(out);
+    fclose(f);
+    cr_assert_eq(ret, 0, "Stereo 16 kHz input was rejected.  Got: %d", ret);
+    char *exp = "0\t0\t400\t5\n0\t400\t800\t5\n1\t800\t1200\t#\n1\t1200\t1600\t#\n";
+    cr_assert_str_eq(events, exp, "Wrong events.  Got: %s | Expected: %s", events, exp);
+    free(events);
+}
+
+struct stream_job {
+    FILE *in, *out;
+    GOERTZEL_BANK bank;
+    int ret;
+};
+
+static void *stream_thread(void *arg) {
+    struct stream_job *job = arg;
+    job->ret = dtmf_detect_stream(job->in, job->out, &job->bank, 50);
+    fclose(job->out);
+    return NULL;
+}
+
+/* read_lines - read from fd until want newlines have arrived, or 5 seconds pass */
+static int read_lines(int fd, char *buf, int len, int size, int want) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int lines = 0;
+    for(int i = 0; i < len; i++)
+	lines += buf[i] == '\n';
+    while(lines < want && len < size - 1 && poll(&pfd, 1, 5000) == 1) {
+	ssize_t got = read(fd, buf + len, size - 1 - len);
+	if(got <= 0)
+	    break;
+	for(int i = len; i < len + got; i++)
+	    lines += buf[i] == '\n';
+	len += got;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+Test(basecode_tests_suite, detect_stream_test) {
+    //stereo through pipes, windows of 100 every 50: '5' on channel 0, then '#' on channel 1
+    int n = 1200;
+    int in[2], out[2];
+    pipe(in);
+    pipe(out);
+    struct stream_job job;
+    job.in = fdopen(in[0], "r");
+    job.out = fdopen(out[1], "w");
+    goertzel_bank_init(&job.bank, 100, dtmf_freqs, NUM_DTMF_FREQS, AUDIO_FRAME_RATE);
+    pthread_t tid;
+    pthread_create(&tid, NULL, stream_thread, &job);
+    FILE *f = fdopen(in[1], "w");
+    AUDIO_HEADER hdr = {AUDIO_MAGIC, AUDIO_DATA_OFFSET, 2 * 2 * n, PCM16_ENCODING, AUDIO_FRAME_RATE, 2};
+    audio_write_header(f, &hdr);
+    char buf[256];
+    int len = 0;
+    for(int i = 0; i < n; i++) {
+	double tone5 = 0.4 * cos(2 * M_PI * 770 * i / 8000.0) + 0.4 * cos(2 * M_PI * 1336 * i / 8000.0);
+	double toneh = 0.4 * cos(2 * M_PI * 941 * i / 8000.0) + 0.4 * cos(2 * M_PI * 1477 * i / 8000.0);
+	audio_write_sample(f, (int16_t)((i < 400 ? tone5 : 0) * INT16_MAX));
+	audio_write_sample(f, (int16_t)((i >= 600 && i < 1000 ? toneh : 0) * INT16_MAX));
+	if(i + 1 == 500) {
+	    //the first tone has ended, and its records must be out while the input is still open
+	    fflush(f);
+	    len = read_lines(out[0], buf, len, sizeof(buf), 2);
+	    char *exp = "start\t0\t0\t5\nend\t0\t0\t400\t5\n";
+	    cr_assert_str_eq(buf, exp, "Records were not flushed.  Got: %s | Expected: %s", buf, exp);
+	}
+    }
+    fclose(f);
+    len = read_lines(out[0], buf, len, sizeof(buf), 4);
+    pthread_join(tid, NULL);
+    fclose(job.in);
+    close(out[0]);
+    cr_assert_eq(job.ret, 0, "Streaming detection failed.  Got: %d", job.ret);
+    char *exp = "start\t0\t0\t5\nend\t0\t0\t400\t5\nstart\t1\t600\t#\nend\t1\t600\t1000\t#\n";
+    cr_assert_str_eq(buf, exp, "Wrong records.  Got: %s | Expected: %s", buf, exp);
+}
+
+/* detect_with_jobs - run dtmf_detect on a file with some number of jobs, into a string */
+static int detect_with_jobs(FILE *f, int jobs, char *telemetry, char **eventsp) {
+    size_t len = 0;
+    *eventsp = NULL;
+    FILE *out = open_memstream(eventsp, &len);
+    global_options = DETECT_OPTION;
+    num_jobs = jobs;
+    batch_count = 0;
+    stream_mode = 0;
+    telemetry_file = telemetry;
+    tone_families = NULL;
+    rewind(f);
+    int ret = dtmf_detect(f, out);
+    fclose(out);
+    return ret;
+}
+
+/* file_bytes - the contents of a file, with its length */
+static char *file_bytes(char *path, size_t *lenp) {
+    FILE *f = fopen(path, "r");
+    fseek(f, 0, SEEK_END);
+    *lenp = ftell(f);
+    rewind(f);
+    char *bytes = malloc(*lenp + 1);
+    *lenp = fread(bytes, 1, *lenp, f);
+    fclose(f);
+    return bytes;
+}
+
+/* write_tone - write the samples [start, end) of a DTMF tone */
+static void write_tone(FILE *f, int start, int end, int row, int col) {
+    for(int i = start; i < end; i++) {
+	double v = 0.4 * cos(2 * M_PI * row * i / 8000.0) + 0.4 * cos(2 * M_PI * col * i / 8000.0);
+	audio_write_sample(f, (int16_t)(v * INT16_MAX));
+    }
+}
+
+Test(basecode_tests_suite, detect_jobs_test) {
+    //more blocks than two threads take in a round, and a short block at the end,
+    //with tones at the start, across the end of the first round, and at the end
+    block_size = 100;
+    int round = 100 * 2 * DETECT_ROUND_BLOCKS;
+    int n = round + 100 * 5 + 37;
+    AUDIO_HEADER hdr = {AUDIO_MAGIC, AUDIO_DATA_OFFSET, 2 * n, PCM16_ENCODING, AUDIO_FRAME_RATE, 1};
+    FILE *f = tmpfile();
+    audio_write_header(f, &hdr);
+    write_tone(f, 0, 3000, 697, 1209);
+    audio_write_silence(f, round - 700 - 3000);
+    write_tone(f, round - 700, round + 250, 770, 1336);
+    audio_write_silence(f, n - 300 - (round + 250));
+    write_tone(f, n - 300, n, 941, 1477);
+    char path[] = "/tmp/telemetry_test_XXXXXX";
+    close(mkstemp(path));
+    char *exp, *got;
+    cr_assert_eq(detect_with_jobs(f, 1, NULL, &exp), 0, "Detection on 1 job failed.");
+    cr_assert(strlen(exp) > 0, "No events were detected.");
+    cr_assert_eq(detect_with_jobs(f, 1, path, &got), 0, "Detection with telemetry failed.");
+    free(got);
+    size_t exp_len;
+    char *exp_tel = file_bytes(path, &exp_len);
+    int jobs[] = {2, 3, 8};
+    for(int j = 0; j < sizeof(jobs) / sizeof(*jobs); j++) {
+	cr_assert_eq(detect_with_jobs(f, jobs[j], NULL, &got), 0, "Detection on %d jobs failed.",
+		     jobs[j]);
+	cr_assert_str_eq(got, exp, "Events on %d jobs differ from those on 1.", jobs[j]);
+	free(got);
+	cr_assert_eq(detect_with_jobs(f, jobs[j], path, &got), 0,
+		     "Detection on %d jobs with telemetry failed.", jobs[j]);
+	free(got);
+	size_t got_len;
+	char *got_tel = file_bytes(path, &got_len);
+	cr_assert(got_len == exp_len && memcmp(got_tel, exp_tel, exp_len) == 0,
+		  "Telemetry on %d jobs differs from that on 1.", jobs[j]);
+	free(got_tel);
+    }
+    free(exp);
+    free(exp_tel);
+    unlink(path);
+    fclose(f);
+}
+
+/* write_au - write an audio file holding a DTMF tone of n samples */
+static void write_au(char *path, int n, int row, int col) {
+    AUDIO_HEADER hdr = {AUDIO_MAGIC, AUDIO_DATA_OFFSET, 2 * n, PCM16_ENCODING, AUDIO_FRAME_RATE, 1};
+    FILE *f = fopen(path, "w");
+    audio_write_header(f, &hdr);
+    write_tone(f, 0, n, row, col);
+    fclose(f);
+}
+
+Test(basecode_tests_suite, detect_batch_test) {
+    char dir[] = "/tmp/batch_test_XXXXXX";
+    cr_assert_not_null(mkdtemp(dir), "Could not make a directory.");
+    char a[64], b[64], notes[64], missing[64];
+    snprintf(a, sizeof(a), "%s/a.au", dir);
+    snprintf(b, sizeof(b), "%s/b.au", dir);
+    snprintf(notes, sizeof(notes), "%s/notes.txt", dir);
+    snprintf(missing, sizeof(missing), "%s/missing.au", dir);
+    write_au(b, 300, 697, 1209);
+    write_au(a, 200, 941, 1477);
+    write_au(notes, 200, 941, 1477);
+    const TONE_FAMILY *dtmf = tone_family_find("dtmf", 4);
+    TONE_SET set;
+    tone_set_init(&set, &dtmf, 1, 100, AUDIO_FRAME_RATE);
+    //a file, then a directory, which stands for its .au files in name order
+    char *paths[] = {b, dir};
+    char exp[1024];
+    snprintf(exp, sizeof(exp), "%s\t0\t100\t1\n%s\t100\t200\t1\n%s\t200\t300\t1\n"
+	     "%s\t0\t100\t#\n%s\t100\t200\t#\n"
+	     "%s\t0\t100\t1\n%s\t100\t200\t1\n%s\t200\t300\t1\n", b, b, b, a, a, b, b, b);
+    int jobs[] = {1, 2, 8};
+    char *events;
+    size_t len;
+    for(int j = 0; j < sizeof(jobs) / sizeof(*jobs); j++) {
+	FILE *out = open_memstream(&events, &len);
+	int ret = dtmf_detect_batch(paths, 2, out, &set, jobs[j]);
+	fclose(out);
+	cr_assert_eq(ret, 0, "Batch on %d jobs failed.  Got: %d", jobs[j], ret);
+	cr_assert_str_eq(events, exp, "Wrong events on %d jobs.  Got: %s | Expected: %s",
+			 jobs[j], events, exp);
+	free(events);
+    }
+    //an unreadable file is reported, and fails the batch, but the rest is processed
+    char *bad[] = {missing, a};
+    FILE *err = tmpfile();
+    fflush(stderr);
+    int saved = dup(2);
+    dup2(fileno(err), 2);
+    FILE *out = open_memstream(&events, &len);
+    int ret = dtmf_detect_batch(bad, 2, out, &set, 2);
+    fclose(out);
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+    char msg[128];
+    rewind(err);
+    msg[fread(msg, 1, sizeof(msg) - 1, err)] = '\0';
+    fclose(err);
+    cr_assert_eq(ret, EOF, "A batch with an unreadable file succeeded.");
+    snprintf(exp, sizeof(exp), "%s: not a readable PCM16 audio file\n", missing);
+    cr_assert_str_eq(msg, exp, "Wrong message.  Got: %s | Expected: %s", msg, exp);
+    snprintf(exp, sizeof(exp), "%s\t0\t100\t#\n%s\t100\t200\t#\n", a, a);
+    cr_assert_str_eq(events, exp, "Wrong events.  Got: %s | Expected: %s", events, exp);
+    free(events);
+    unlink(a);
+    unlink(b);
+    unlink(notes);
+    rmdir(dir);
+}
+
+Test(basecode_tests_suite, goertzel_bank_matches_scalar_test) {
+    int N = 205;
+    int16_t x[205];
+    for(int i = 0; i < N; i++)
+	x[i] = (int16_t)(16000 * cos(2 * M_PI * 770 * i / 8000.0) + 8000 * cos(2 * M_PI * 1477 * i / 8000.0));
+    GOERTZEL_BANK bank;
+    goertzel_bank_init(&bank, N, dtmf_freqs, NUM_DTMF_FREQS, AUDIO_FRAME_RATE);
+    goertzel_bank_run(&bank, x, N-1);
+    goertzel_bank_strength(&bank, x[N-1]);
+    for(int j = 0; j < NUM_DTMF_FREQS; j++) {
+#ifdef GOERTZEL_FIXED
+	GOERTZEL_FIXED_STATE g;
+	goertzel_fixed_init(&g, N, N * (double)dtmf_freqs[j] / AUDIO_FRAME_RATE);
+	for(int i = 0; i < N-1; i++)
+	    goertzel_fixed_step(&g, x[i]);
+	double r = goertzel_fixed_strength(&g, x[N-1]);
+#else
+	GOERTZEL_STATE g;
+	goertzel_init(&g, N, N * (double)dtmf_freqs[j] / AUDIO_FRAME_RATE);
+	for(int i = 0; i < N-1; i++)
+	    goertzel_step(&g, (double)x[i] / INT16_MAX);
+	double r = goertzel_strength(&g, (double)x[N-1] / INT16_MAX);
+#endif
+	cr_assert_eq(bank.y[j], r, "Bank strength %d was %f, should be %f", j, bank.y[j], r);
+    }
+}
+
+Test(basecode_tests_suite, goertzel_fixed_test) {
+    int N = 1000;
+    int16_t x[1000];
+    for(int i = 0; i < N; i++)
+	x[i] = (int16_t)(16383 * cos(2 * M_PI * 941 * i / 8000.0) + 16383 * cos(2 * M_PI * 1633 * i / 8000.0));
+    for(int j = 0; j < NUM_DTMF_FREQS; j++) {
+	double k = N * (double)dtmf_freqs[j] / AUDIO_FRAME_RATE;
+	cr_assert(goertzel_fixed_fits(N, k), "State for %d Hz could overflow", dtmf_freqs[j]);
+	GOERTZEL_STATE g;
+	GOERTZEL_FIXED_STATE q;
+	goertzel_init(&g, N, k);
+	goertzel_fixed_init(&q, N, k);
+	for(int i = 0; i < N-1; i++) {
+	    goertzel_step(&g, (double)x[i] / INT16_MAX);
+	    goertzel_fixed_step(&q, x[i]);
+	}
+	double r = goertzel_strength(&g, (double)x[N-1] / INT16_MAX);
+	double f = goertzel_fixed_strength(&q, x[N-1]);
+	cr_assert(fabs(f - r) <= 1e-6, "Fixed strength %d was %g, should be %g", j, f, r);
+    }
+}
+
+/* reference_decide - the original comparison chain, with divisions */
+static int reference_decide(const double *y) {
+    int rowInd = 0;
+    int columnInd = 0;
+    double maxRow = 0;
+    double maxColumn = 0;
+    double y0 = *(y + 0), y1 = *(y + 1), y2 = *(y + 2), y3 = *(y + 3);
+    double y4 = *(y + 4), y5 = *(y + 5), y6 = *(y + 6), y7 = *(y + 7);
+    //find the max row and column frequencies
+    if (y0 >= maxRow){
+        maxRow = y0;
+    }
+    if (y1 >= maxRow){
+        maxRow = y1;
+    }
+    if (y2 >= maxRow){
+        maxRow = y2;
+    }
+    if (y3 >= maxRow){
+        maxRow = y3;
+    }
+    if (y4 >= maxColumn) {
+        maxColumn = y4;
+    }
+    if (y5 >= maxColumn){
+        maxColumn = y5;
+    }
+    if (y6 >= maxColumn){
+        maxColumn = y6;
+    }
+    if (y7 >= maxColumn){
+        maxColumn = y7;
+    }
+    //check if minimum of -20dB is met
+    if ((maxRow + maxColumn) < MINUS_20DB) {
+        return 0;
+    }
+    //check if twist between -4dB and 4dB
+    if ((maxRow/maxColumn) > FOUR_DB || (maxColumn/maxRow) > FOUR_DB){
+        return 0;
+    }
+    //check that the strongest row and column dominate the others by 6dB
+    if ((maxRow/y0) < SIX_DB && (maxRow/y0) != 1) {
+        return 0;
+    }
+    if ((maxRow/y1) < SIX_DB && (maxRow/y1) != 1) {
+        return 0;
+    }
+    if ((maxRow/y2) < SIX_DB && (maxRow/y2) != 1) {
+        return 0;
+    }
+    if ((maxRow/y3) < SIX_DB && (maxRow/y3) != 1) {
+        return 0;
+    }
+    if ((maxColumn/y4) < SIX_DB && (maxColumn != y4)) {
+        return 0;
+    }
+    if ((maxColumn/y5) < SIX_DB && (maxColumn != y5)) {
+        return 0;
+    }
+    if ((maxColumn/y6) < SIX_DB && (maxColumn != y6)) {
+        return 0;
+    }
+    if ((maxColumn/y7) < SIX_DB && (maxColumn != y7)) {
+        return 0;
+    }
+
+    if (maxRow == y0) {
+        rowInd = 0;
+    }
+    else if(maxRow == y1) {
+        rowInd = 1;
+    }
+    else if(maxRow == y2) {
+        rowInd = 2;
+    }
+    else if(maxRow == y3) {
+        rowInd = 3;
+    }
+    if (maxColumn == y4) {
+        columnInd = 0;
+    }
+    else if (maxColumn == y5) {
+        columnInd = 1;
+    }
+    else if (maxColumn == y6) {
+        columnInd = 2;
+    }
+    else if (maxColumn == y7) {
+        columnInd = 3;
+    }
+    return *(*(dtmf_symbol_names + rowInd) + columnInd);
+}
+
+Test(basecode_tests_suite, dtmf_decide_test) {
+    double y[8];
+    srand(12345);
+    for(int t = 0; t < 1000000; t++) {
+	//a random row and column, at random levels above a random background
+	double floor = (double)rand() / RAND_MAX * 0.05;
+	for(int j = 0; j < 8; j++)
+	    y[j] = floor * rand() / RAND_MAX;
+	y[rand() % 4] = (double)rand() / RAND_MAX * 0.3;
+	y[4 + rand() % 4] = (double)rand() / RAND_MAX * 0.3;
+	//exercise ties, zeros and (tiny) negative strengths
+	if(t % 7 == 0)
+	    y[rand() % 8] = y[rand() % 8];
+	if(t % 11 == 0)
+	    y[rand() % 8] = 0;
+	if(t % 13 == 0)
+	    y[rand() % 8] = -1e-18;
+	if(t % 17 == 0)
+	    y[rand() % 8] = -0.0;
+	int got = dtmf_decide(y);
+	int exp = reference_decide(y);
+	cr_assert_eq(got, exp, "Case %d: decision was %d, should be %d", t, got, exp);
+	//the scalar decision, which serves other builds and the telemetry replay
+	got = dtmf_decide_limits(y, MINUS_20DB, FOUR_DB, SIX_DB);
+	cr_assert_eq(got, exp, "Case %d: scalar decision was %d, should be %d", t, got, exp);
+    }
+    double tie[8] = {0.1, 0.1, 0, 0, 0, 0, 0.1, 0};
+    cr_assert_eq(dtmf_decide(tie), '3', "Tied maxima should select the first row.");
+    double twist[8] = {0.1, 0, 0, 0, 0, 0, 0.1 / FOUR_DB * 0.999, 0};
+    cr_assert_eq(dtmf_decide(twist), 0, "Twist beyond 4dB was accepted.");
+}
+
+Test(basecode_tests_suite, synth_tone_test) {
+    uint32_t start = 12345;
+    SYNTH_TONE tone;
+    synth_tone_init(&tone, 852, 1477, start);
+    for(uint32_t i = start; i < start + 20000; i++) {
+	int16_t got = synth_tone_next(&tone);
+	double row = cos(2.0 * M_PI * 852 * (double)i / (double)AUDIO_FRAME_RATE);
+	double col = cos(2.0 * M_PI * 1477 * (double)i / (double)AUDIO_FRAME_RATE);
+	int16_t exp = (int16_t)(((0.5 * row) + (0.5 * col)) * INT16_MAX);
+	cr_assert(abs(got - exp) <= 1, "Sample %u was %d, should be %d", i, got, exp);
+    }
+}
+
+Test(basecode_tests_suite, synth_render_test) {
+    //bulk rendering, across reseeding points, agrees with sample-by-sample generation
+    uint32_t start = 12345;
+    int n = 3000;
+    int16_t bulk[3000];
+    SYNTH_TONE tone, ref;
+    synth_tone_init(&tone, 941, 1633, start);
+    synth_tone_init(&ref, 941, 1633, start);
+    synth_tone_render(&tone, bulk, 7);
+    synth_tone_render(&tone, bulk + 7, n - 7);
+    for(int i = 0; i < n; i++) {
+	int16_t exp = synth_tone_next(&ref);
+	cr_assert(abs(bulk[i] - exp) <= 1, "Sample %d was %d, should be %d", i, bulk[i], exp);
+    }
+    cr_assert_eq(tone.index, ref.index, "Wrong index after rendering.");
+}
+
+Test(basecode_tests_suite, synth_events_test) {
+    FILE *f = tmpfile();
+    fputs("0\t800\t1\n1600\t2400\t#\n4000\t4800\tD\n48", f);
+    rewind(f);
+    SYNTH_EVENT ev;
+    int ret = synth_read_event(f, &ev);
+    cr_assert_eq(ret, 1, "Valid event 0 was rejected.");
+    ret = synth_read_event(f, &ev);
+    cr_assert_eq(ret, 1, "Valid event 1 was rejected.");
+    cr_assert(ev.start == 1600 && ev.end == 2400, "Wrong span for event 1.");
+    cr_assert(ev.row == 941 && ev.col == 1477, "Wrong frequencies for '#'.");
+    ret = synth_read_event(f, &ev);
+    cr_assert_eq(ret, 1, "Valid event 2 was rejected.");
+    cr_assert(ev.row == 941 && ev.col == 1633, "Wrong frequencies for 'D'.");
+    cr_assert_eq(synth_read_event(f, &ev), 0, "A final partial line was not ignored.");
+    fclose(f);
+    f = tmpfile();
+    fputs("0\t800\t1\n900\t850\t2\n", f);
+    rewind(f);
+    cr_assert_eq(synth_read_event(f, &ev), 1, "Valid event was rejected.");
+    ret = synth_read_event(f, &ev);
+    fclose(f);
+    cr_assert_eq(ret, EOF, "An event ending before its start was accepted.");
+}
+
+Test(basecode_tests_suite, noise_reader_test) {
+    //an annotated noise file of one block and a few samples more
+    int n = NOISE_BLOCK + 3;
+    AUDIO_HEADER hdr = {AUDIO_MAGIC, AUDIO_DATA_OFFSET + 8, 2 * n, PCM16_ENCODING,
+			AUDIO_FRAME_RATE, AUDIO_CHANNELS};
+    char path[] = "/tmp/noise_test_XXXXXX";
+    FILE *f = fdopen(mkstemp(path), "w");
+    audio_write_header(f, &hdr);
+    fwrite("notes!!", 1, 8, f);
+    for(int i = 0; i < n; i++)
+	audio_write_sample(f, i % 1000 + 1);
+    fclose(f);
+    int m = 2 * n + 10;
+    int16_t *buf = malloc(m * sizeof(int16_t));
+    NOISE_READER noise;
+    int ret = noise_open(&noise, path, 0);
+    cr_assert_eq(ret, 0, "Valid noise file was rejected.  Got: %d", ret);
+    noise_read(&noise, buf, 7);
+    noise_read(&noise, buf + 7, m - 7);
+    noise_close(&noise);
+    for(int i = 0; i < m; i++) {
+	int expected = i < n ? i % 1000 + 1 : 0;
+	cr_assert_eq(buf[i], expected, "Sample %d was %d, should be %d", i, buf[i], expected);
+    }
+    ret = noise_open(&noise, path, 1);
+    cr_assert_eq(ret, 0, "Valid noise file was rejected.  Got: %d", ret);
+    noise_read(&noise, buf, m);
+    noise_close(&noise);
+    for(int i = 0; i < m; i++) {
+	int expected = i % n % 1000 + 1;
+	cr_assert_eq(buf[i], expected, "Looped sample %d was %d, should be %d", i, buf[i], expected);
+    }
+    free(buf);
+    unlink(path);
+    cr_assert_eq(noise_open(&noise, path, 0), EOF, "A missing noise file was accepted.");
+}
+
+Test(basecode_tests_suite, telemetry_test) {
+    FILE *f = tmpfile();
+    TELEMETRY_LIMITS limits = {MINUS_20DB, FOUR_DB, SIX_DB};
+    double y[8];
+    srand(54321);
+    int ret = telemetry_write_header(f, 205, 16000, 2);
+    for(int t = 0; t < 10000 && ret == 0; t++) {
+	double floor = (double)rand() / RAND_MAX * 0.05;
+	for(int j = 0; j < 8; j++)
+	    y[j] = floor * rand() / RAND_MAX;
+	y[rand() % 4] = (double)rand() / RAND_MAX * 0.3;
+	y[4 + rand() % 4] = (double)rand() / RAND_MAX * 0.3;
+	if(t % 13 == 0)
+	    y[rand() % 8] = -1e-18;
+	ret = telemetry_write_record(f, (uint64_t)t * 205 + ((uint64_t)1 << 40), 205, t % 2,
+				     dtmf_decide(y), y);
+    }
+    cr_assert_eq(ret, 0, "Telemetry could not be written.");
+    rewind(f);
+    TELEMETRY_HEADER header;
+    ret = telemetry_read_header(f, &header);
+    cr_assert_eq(ret, 0, "Telemetry header was rejected.");
+    cr_assert(header.block_size == 205 && header.sample_rate == 16000 && header.channels == 2,
+	      "Telemetry header did not round-trip.");
+    cr_assert_eq(header.freqs[7], 1633, "Wrong frequency in telemetry header.");
+    srand(54321);
+    TELEMETRY_RECORD record;
+    for(int t = 0; t < 10000; t++) {
+	ret = telemetry_read_record(f, &record);
+	cr_assert_eq(ret, 0, "Record %d could not be read.", t);
+	cr_assert(record.start == (uint64_t)t * 205 + ((uint64_t)1 << 40) && record.frames == 205
+		  && record.channel == t % 2, "Record %d did not round-trip.", t);
+	int decided = telemetry_decide(record.y, &limits);
+	cr_assert_eq(decided, record.symbol, "Replay of record %d was %d, should be %d",
+		     t, decided, record.symbol);
+    }
+    cr_assert_eq(telemetry_read_record(f, &record), EOF, "Read past the last record.");
+    fclose(f);
+}
+
+Test(basecode_tests_suite, tone_families_test) {
+    const TONE_FAMILY *families[TONE_MAX_FAMILIES];
+    int count = tone_parse_families("dtmf,mf,cp", families);
+    cr_assert_eq(count, 3, "Families were not parsed.  Got: %d", count);
+    cr_assert_eq(tone_parse_families("mf,dtmf,mf", families), -1, "A repeated family was accepted.");
+    cr_assert_eq(tone_parse_families("dtmf,", families), -1, "An empty family was accepted.");
+    cr_assert_eq(tone_parse_families("dtm", families), -1, "An unknown family was accepted.");
+    count = tone_parse_families("dtmf,mf,cp", families);
+    for(int i = 0; i < NUM_DTMF_FREQS; i++)
+	cr_assert_eq(families[0]->freqs[i], dtmf_freqs[i], "DTMF frequency %d differs.", i);
+    TONE_SET set;
+    int ret = tone_set_init(&set, families, count, 400, AUDIO_FRAME_RATE);
+    cr_assert_eq(ret, 0, "Set of families was rejected.");
+    cr_assert(set.named, "Events of several families should be named.");
+    TONE_SET parsed;
+    cr_assert_eq(tone_set_parse(&parsed, "dtm"), -1, "An unknown family was accepted in a set.");
+    ret = tone_set_parse(&parsed, "dtmf");
+    cr_assert_eq(ret, 1, "Set was not parsed.  Got: %d | Expected: %d", ret, 1);
+    ret = tone_set_bank(&parsed, 400, AUDIO_FRAME_RATE);
+    cr_assert_eq(ret, 0, "Bank of a parsed set was rejected.");
+    cr_assert(!parsed.named, "Events of dtmf alone should not be named.");
+    //one block of each pair, and the symbol expected of each family
+    struct { int f1, f2; char exp[3]; } cases[] = {
+	{770, 1336, {'5', 0, 0}}, {1100, 1700, {0, 'K', 0}}, {1300, 1500, {0, '0', 0}},
+	{350, 440, {0, 0, 'D'}}, {440, 480, {0, 0, 'R'}}, {480, 620, {0, 0, 'B'}}, {0, 0, {0, 0, 0}}
+    };
+    uint8_t x[2 * 400];
+    uint8_t symbols[TONE_MAX_FAMILIES];
+    GOERTZEL_BANK bank = set.bank;
+    for(int c = 0; c < sizeof(cases) / sizeof(*cases); c++) {
+	for(int i = 0; i < 400; i++) {
+	    double v = cases[c].f1 == 0 ? 0 : 0.4 * cos(2 * M_PI * cases[c].f1 * i / 8000.0)
+		+ 0.4 * cos(2 * M_PI * cases[c].f2 * i / 8000.0);
+	    int16_t s = (int16_t)(v * INT16_MAX);
+	    x[2 * i] = (uint16_t)s >> 8;
+	    x[2 * i + 1] = s & 0xff;
+	}
+	int found = tone_analyze_block_be(&bank, &set, x, 400, 1, symbols);
+	cr_assert_eq(found, cases[c].f1 != 0, "Case %d: wrong outcome.", c);
+	for(int f = 0; f < count; f++)
+	    cr_assert_eq(symbols[f], cases[c].exp[f], "Case %d, family %s: symbol was %d, should be %d",
+			 c, families[f]->name, symbols[f], cases[c].exp[f]);
+    }
+    const TONE_FAMILY *dtmf = tone_family_find("dtmf", 4);
+    tone_set_init(&set, &dtmf, 1, 100, AUDIO_FRAME_RATE);
+    cr_assert(!set.named, "Events of DTMF alone should not be named.");
+}
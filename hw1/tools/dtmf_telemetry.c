@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "const.h"
+#include "telemetry.h"
+
+/*
+ * Summary of a telemetry file written by dtmf -d -T.
+ *
+ * The file is read in one pass, so that it may hold any number of blocks.
+ * For each criterion of the decision, the distribution of its margin over
+ * the blocks is reported separately for the blocks in which a tone was
+ * detected and for the others, so that it can be seen how close each
+ * threshold is to the blocks that it accepts and rejects.  The decision is
+ * also replayed on the recorded strengths with thresholds given on the
+ * command line, and the outcome is compared with the recorded one.  With
+ * the default thresholds, those of const.h, the replay reproduces the
+ * recorded decisions exactly.
+ */
+
+#define TELEMETRY_USAGE \
+"USAGE: %s [-m DB] [-f DB] [-s DB] [TELEMETRY_FILE]\n" \
+"   -m DB   level threshold, the minimum sum of the row and column maxima (default -20)\n" \
+"   -f DB   twist threshold, the largest difference of the row and column maxima (default 4)\n" \
+"   -s DB   dominance threshold, the smallest margin of each maximum over the\n" \
+"           other strengths of its group (default 6)\n" \
+"   The telemetry file is read from standard input if it is not named.\n"
+
+#define HIST_MIN (-100)   // Lowest margin, in dB, of the histograms.
+#define HIST_MAX 100      // Highest margin, in dB, of the histograms.
+#define HIST_PER_DB 2     // Bins of the histograms per dB.
+#define HIST_BINS ((HIST_MAX - HIST_MIN) * HIST_PER_DB + 2)  // With underflow and overflow bins.
+
+/* Margins whose distributions are reported. */
+enum { M_LEVEL, M_TWIST, M_ROW, M_COLUMN, NUM_MARGINS };
+static const char *margin_names[NUM_MARGINS] = { "level", "twist", "row dom.", "col. dom." };
+
+typedef struct histogram {
+    uint64_t count;
+    uint64_t bins[HIST_BINS];
+} HISTOGRAM;
+
+static void hist_add(HISTOGRAM *hp, double db) {
+    int bin;
+    if (!(db >= HIST_MIN)) {
+        bin = 0;  //also -inf, and the nan of a group with no strength
+    }
+    else if (db >= HIST_MAX) {
+        bin = HIST_BINS - 1;
+    }
+    else {
+        bin = 1 + (int)((db - HIST_MIN) * HIST_PER_DB);
+    }
+    hp->bins[bin]++;
+    hp->count++;
+}
+
+/* hist_print_quantile - the upper edge of the bin holding quantile q */
+static void hist_print_quantile(const HISTOGRAM *hp, double q) {
+    uint64_t rank = (uint64_t)ceil(q * hp->count);
+    uint64_t seen = 0;
+    int bin = 0;
+    while (bin < HIST_BINS - 1 && (seen += hp->bins[bin]) < (rank > 0 ? rank : 1)) {
+        bin++;
+    }
+    if (bin == 0) {
+        printf(" %8s", "low");
+    }
+    else if (bin == HIST_BINS - 1) {
+        printf(" %8s", "high");
+    }
+    else {
+        printf(" %8.1f", HIST_MIN + (double)bin / HIST_PER_DB);
+    }
+}
+
+/* to_db - a power ratio in dB */
+static double to_db(double ratio) {
+    return 10 * log10(ratio);
+}
+
+/*
+ * margins - the margin of a block on each criterion, in dB, each positive
+ * when the criterion is satisfied with the thresholds of lp.
+ */
+static void margins(const double *y, const TELEMETRY_LIMITS *lp, double *mp) {
+    double max[2], second[2];
+    for (int g = 0; g < 2; g++) {
+        max[g] = 0;
+        second[g] = 0;
+        for (int i = 0; i < 4; i++) {
+            double v = y[4 * g + i];
+            if (v > max[g]) {
+                second[g] = max[g];
+                max[g] = v;
+            }
+            else if (v > second[g]) {
+                second[g] = v;
+            }
+        }
+    }
+    double high = max[0] > max[1] ? max[0] : max[1];
+    double low = max[0] > max[1] ? max[1] : max[0];
+    mp[M_LEVEL] = to_db((max[0] + max[1]) / lp->level);
+    mp[M_TWIST] = to_db(lp->twist * low / high);
+    mp[M_ROW] = to_db(max[0] / (lp->dominance * second[0]));
+    mp[M_COLUMN] = to_db(max[1] / (lp->dominance * second[1]));
+}
+
+static int symbol_index(int symbol) {
+    const char *symbols = "0123456789ABCD*#";
+    for (int i = 0; i < 16; i++) {
+        if (symbols[i] == symbol) {
+            return i;
+        }
+    }
+    return 16;
+}
+
+int main(int argc, char **argv) {
+    TELEMETRY_LIMITS limits = { MINUS_20DB, FOUR_DB, SIX_DB };
+    int opt;
+    while ((opt = getopt(argc, argv, "m:f:s:")) != -1) {
+        switch (opt) {
+        case 'm': limits.level = pow(10, atof(optarg) / 10); break;
+        case 'f': limits.twist = pow(10, atof(optarg) / 10); break;
+        case 's': limits.dominance = pow(10, atof(optarg) / 10); break;
+        default:
+            fprintf(stderr, TELEMETRY_USAGE, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind > 1) {
+        fprintf(stderr, TELEMETRY_USAGE, argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *in = stdin;
+    if (optind < argc && (in = fopen(argv[optind], "r")) == NULL) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    TELEMETRY_HEADER header;
+    if (telemetry_read_header(in, &header) == EOF) {
+        fprintf(stderr, "%s: not a telemetry file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    //recorded and replayed decisions per symbol (the last entry is for no tone)
+    uint64_t recorded[17] = { 0 }, replayed[17] = { 0 };
+    uint64_t gained = 0, lost = 0, swapped = 0, blocks = 0;
+    uint64_t frames = 0;
+    //margins with respect to the given thresholds, for blocks without and with a tone
+    static HISTOGRAM hist[2][NUM_MARGINS];
+    TELEMETRY_RECORD record;
+    while (telemetry_read_record(in, &record) == 0) {
+        int symbol = telemetry_decide(record.y, &limits);
+        recorded[symbol_index(record.symbol)]++;
+        replayed[symbol_index(symbol)]++;
+        gained += record.symbol == 0 && symbol != 0;
+        lost += record.symbol != 0 && symbol == 0;
+        swapped += record.symbol != 0 && symbol != 0 && symbol != record.symbol;
+        double m[NUM_MARGINS];
+        margins(record.y, &limits, m);
+        for (int i = 0; i < NUM_MARGINS; i++) {
+            hist_add(&hist[record.symbol != 0][i], m[i]);
+        }
+        if (record.channel == 0) {
+            frames = record.start + record.frames;
+        }
+        blocks++;
+    }
+    if (ferror(in)) {
+        perror(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("blocks: %lu of %u frames, %u channel(s), %u Hz, %.1f s\n", (unsigned long)blocks,
+           header.block_size, header.channels, header.sample_rate, (double)frames / header.sample_rate);
+    printf("thresholds: level %.2f dB, twist %.2f dB, dominance %.2f dB\n\n",
+           to_db(limits.level), to_db(limits.twist), to_db(limits.dominance));
+
+    printf("%-10s %-8s %12s %8s %8s %8s %8s %8s\n", "margin dB", "blocks", "count",
+           "1%", "10%", "50%", "90%", "99%");
+    const double q[] = { 0.01, 0.10, 0.50, 0.90, 0.99 };
+    for (int tone = 1; tone >= 0; tone--) {
+        for (int i = 0; i < NUM_MARGINS; i++) {
+            printf("%-10s %-8s %12lu", margin_names[i], tone ? "tone" : "no tone",
+                   (unsigned long)hist[tone][i].count);
+            for (int j = 0; j < 5; j++) {
+                hist_print_quantile(&hist[tone][i], q[j]);
+            }
+            printf("\n");
+        }
+    }
+
+    printf("\nsymbol  %12s %12s\n", "recorded", "replayed");
+    const char *symbols = "0123456789ABCD*#";
+    for (int i = 0; i < 17; i++) {
+        if (recorded[i] != 0 || replayed[i] != 0) {
+            printf("%-6.*s  %12lu %12lu\n", i < 16 ? 1 : 4, i < 16 ? symbols + i : "none",
+                   (unsigned long)recorded[i], (unsigned long)replayed[i]);
+        }
+    }
+    printf("\nreplay: %lu gained, %lu lost, %lu changed symbol\n",
+           (unsigned long)gained, (unsigned long)lost, (unsigned long)swapped);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return EXIT_SUCCESS;
+}
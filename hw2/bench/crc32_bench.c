@@ -0,0 +1,91 @@
+/****************************************************************\
+|  crc32_bench.c - throughput of the CRC32 engines of finddup
+|----------------------------------------------------------------
+|  Times each engine on a random buffer and reports the fastest
+|  of the repeated runs, in MB/s, with the CRC, which is the same
+|  for all. That the engines agree with rc_crc32 is checked by
+|  crc32_test in the tests.
+\***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include "finddup.h"
+
+#define BENCH_USAGE \
+"USAGE: %s [-s MB] [-r REPEAT]\n" \
+"   -s MB       size of the buffer hashed (default 256)\n" \
+"   -r REPEAT   number of times each engine is timed (default 5)\n"
+
+typedef struct {
+	char *name;
+	uint32_t (*crc)(uint32_t, const char *, size_t);
+} engine;
+
+static engine engines[] = {
+	{ "rc_crc32", rc_crc32 },
+	{ "slice8", crc32_table8 },
+	{ "fast", crc32_fast },
+};
+#define NENGINES (sizeof(engines) / sizeof(engine))
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t size = 256, i;
+	int repeat = 5, ch, r;
+	char *buf;
+	double start, secs, best;
+	volatile uint32_t sink;
+	engine *ep;
+
+	while ((ch = getopt(argc, argv, "s:r:")) != -1) {
+		switch (ch) {
+		case 's': size = atol(optarg); break;
+		case 'r': repeat = atoi(optarg); break;
+		default:
+			fprintf(stderr, BENCH_USAGE, argv[0]);
+			return 1;
+		}
+	}
+	if (size < 1 || repeat < 1) {
+		fprintf(stderr, BENCH_USAGE, argv[0]);
+		return 1;
+	}
+	size <<= 20;
+	if ((buf = (char *) malloc(size)) == NULL) {
+		perror("Can't allocate the buffer");
+		return 1;
+	}
+	srand(1);
+	for (i = 0; i < size; i++) {
+		buf[i] = rand();
+	}
+
+	printf("PCLMULQDQ folding: %s\n", crc32_have_pclmul() ? "yes" : "no");
+	printf("%-10s %12s %10s\n", "engine", "MB/s", "crc");
+	for (ep = engines; ep < engines + NENGINES; ep++) {
+		best = 0;
+		for (r = 0; r < repeat; r++) {
+			start = bench_now();
+			sink = ep->crc(0, buf, size);
+			secs = bench_now() - start;
+			if (r == 0 || secs < best) best = secs;
+		}
+		printf("%-10s %12.1f   %08lx\n", ep->name, size / best / 1e6,
+			(unsigned long) sink);
+	}
+	free(buf);
+	return 0;
+}
@@ -1,5 +1,29 @@
 int att_getopt(int argc, char **argv, char *opts);
 
-int fullcmp(int v1, int v2);
+int fullcmp(long v1, long v2, int n, char *same);
 
-uint32_t rc_crc32(uint32_t crc, const char *buf, size_t len);
\ No newline at end of file
+uint32_t rc_crc32(uint32_t crc, const char *buf, size_t len);
+
+uint32_t crc32_fast(uint32_t crc, const char *buf, size_t len);
+
+uint32_t crc32_table8(uint32_t crc, const char *buf, size_t len);
+
+int crc32_have_pclmul(void);
+
+int crc_file(const char *fname, off_t part, uint32_t *crcp);
+
+void hcache_open(const char *path, off_t partlen);
+
+int hcache_get(uint64_t device, uint64_t inode, int64_t length, int64_t mtime,
+	int64_t ctime, int part, uint32_t *crcp);
+
+void hcache_put(uint64_t device, uint64_t inode, int64_t length, int64_t mtime,
+	int64_t ctime, int part, uint32_t crc);
+
+void hcache_save(void);
+
+struct stat;
+
+int walk_dirs(char **roots, int nroots, int jobs, void (*found)(char *, struct stat *));
+
+int hash_files(long count, int jobs, off_t part, char *(*getname)(long), uint32_t *crcs, int *errs);
\ No newline at end of file
@@ -0,0 +1,170 @@
+/****************************************************************\
+|  crc32fast.c - the CRC32 of rc_crc32, at a higher speed
+|----------------------------------------------------------------
+|  crc32_fast gives the same value as rc_crc32, which remains the
+|  reference, and may be chained the same way. It uses folding by
+|  carry-less multiplication (PCLMULQDQ) when the CPU has it, and
+|  slicing-by-8 otherwise and for the ends of the buffer. Both are
+|  described in Intel's "Fast CRC Computation for Generic
+|  Polynomials Using PCLMULQDQ Instruction" and "A Systematic
+|  Approach to Building High Performance Software-based CRC
+|  Generators". All tables are constant, so any number of threads
+|  may hash at once.
+\***************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include "finddup.h"
+#include "crc32_tables.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_PCLMUL 1
+#include <immintrin.h>
+#endif
+
+#define FOLDMIN	64				/* shortest buffer worth folding */
+
+/* crc32_slice8 - update a CRC register eight bytes at a time */
+
+static uint32_t
+crc32_slice8(uint32_t crc, const unsigned char *p, size_t len)
+{
+	uint32_t lo, hi;
+
+	while (len >= 8) {
+		lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24);
+		hi = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t) p[7] << 24;
+		crc = crc32_tables[7][lo & 0xff] ^ crc32_tables[6][(lo >> 8) & 0xff]
+			^ crc32_tables[5][(lo >> 16) & 0xff] ^ crc32_tables[4][lo >> 24]
+			^ crc32_tables[3][hi & 0xff] ^ crc32_tables[2][(hi >> 8) & 0xff]
+			^ crc32_tables[1][(hi >> 16) & 0xff] ^ crc32_tables[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len-- > 0) {
+		crc = (crc >> 8) ^ crc32_tables[0][(crc ^ *p++) & 0xff];
+	}
+	return crc;
+}
+
+#ifdef HAVE_PCLMUL
+/*
+ * crc32_fold - update a CRC register over a buffer of at least FOLDMIN
+ * bytes and a multiple of 16, by folding four lanes of 128 bits at a
+ * time, then one lane, then reducing the lane to 32 bits
+ */
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t
+crc32_fold(uint32_t crc, const unsigned char *p, size_t len)
+{
+	/* x^n mod P, bit reflected, for the distances folded over */
+	static const uint64_t k512[2] __attribute__((aligned(16))) =
+		{ 0x0154442bd4, 0x01c6e41596 };
+	static const uint64_t k128[2] __attribute__((aligned(16))) =
+		{ 0x01751997d0, 0x00ccaa009e };
+	static const uint64_t k64[2] __attribute__((aligned(16))) =
+		{ 0x0163cd6124, 0 };
+	/* P and floor(x^64 / P), bit reflected, for Barrett reduction */
+	static const uint64_t barrett[2] __attribute__((aligned(16))) =
+		{ 0x01db710641, 0x01f7011641 };
+	__m128i k, mask, a, b, c, d, t;
+
+	a = _mm_loadu_si128((const __m128i *) p);
+	b = _mm_loadu_si128((const __m128i *) (p + 16));
+	c = _mm_loadu_si128((const __m128i *) (p + 32));
+	d = _mm_loadu_si128((const __m128i *) (p + 48));
+	a = _mm_xor_si128(a, _mm_cvtsi32_si128(crc));
+	p += 64;
+	len -= 64;
+
+	/* fold 512 bits ahead at a time */
+	k = _mm_load_si128((const __m128i *) k512);
+	while (len >= 64) {
+#define FOLD(x, off) \
+		t = _mm_clmulepi64_si128(x, k, 0x00); \
+		x = _mm_clmulepi64_si128(x, k, 0x11); \
+		x = _mm_xor_si128(_mm_xor_si128(x, t), \
+			_mm_loadu_si128((const __m128i *) (p + off)));
+		FOLD(a, 0)
+		FOLD(b, 16)
+		FOLD(c, 32)
+		FOLD(d, 48)
+#undef FOLD
+		p += 64;
+		len -= 64;
+	}
+
+	/* fold the four lanes into one, and then the rest of the buffer */
+	k = _mm_load_si128((const __m128i *) k128);
+#define FOLD1(x) \
+	t = _mm_clmulepi64_si128(a, k, 0x00); \
+	a = _mm_clmulepi64_si128(a, k, 0x11); \
+	a = _mm_xor_si128(_mm_xor_si128(a, t), x);
+	FOLD1(b)
+	FOLD1(c)
+	FOLD1(d)
+	while (len >= 16) {
+		FOLD1(_mm_loadu_si128((const __m128i *) p))
+		p += 16;
+		len -= 16;
+	}
+#undef FOLD1
+
+	/* 128 bits to 64 */
+	mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	t = _mm_clmulepi64_si128(a, k, 0x10);
+	a = _mm_xor_si128(_mm_srli_si128(a, 8), t);
+	k = _mm_loadl_epi64((const __m128i *) k64);
+	t = _mm_srli_si128(a, 4);
+	a = _mm_clmulepi64_si128(_mm_and_si128(a, mask), k, 0x00);
+	a = _mm_xor_si128(a, t);
+
+	/* 64 bits to 32 */
+	k = _mm_load_si128((const __m128i *) barrett);
+	t = _mm_clmulepi64_si128(_mm_and_si128(a, mask), k, 0x10);
+	t = _mm_clmulepi64_si128(_mm_and_si128(t, mask), k, 0x00);
+	a = _mm_xor_si128(a, t);
+	return _mm_extract_epi32(a, 1);
+}
+#endif /* HAVE_PCLMUL */
+
+/* crc32_have_pclmul - nonzero if crc32_fast folds with PCLMULQDQ */
+
+int
+crc32_have_pclmul(void)
+{
+#ifdef HAVE_PCLMUL
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#else
+	return 0;
+#endif
+}
+
+/* crc32_fast - the value of rc_crc32(crc, buf, len) */
+
+uint32_t
+crc32_fast(uint32_t crc, const char *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) buf;
+	size_t n;
+
+	crc = ~crc;
+#ifdef HAVE_PCLMUL
+	if (len >= FOLDMIN && crc32_have_pclmul()) {
+		n = len & ~(size_t) 15;
+		crc = crc32_fold(crc, p, n);
+		p += n;
+		len -= n;
+	}
+#endif
+	return ~crc32_slice8(crc, p, len);
+}
+
+/* crc32_table8 - the value of rc_crc32(crc, buf, len), by slicing-by-8 only */
+
+uint32_t
+crc32_table8(uint32_t crc, const char *buf, size_t len)
+{
+	return ~crc32_slice8(~crc, (const unsigned char *) buf, len);
+}
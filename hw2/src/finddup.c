@@ -9,13 +9,17 @@
 |  or any derivative program may not be restricted.
 |----------------------------------------------------------------
 |  Calling sequence:
-|   finddup [-l] checklist
+|   finddup [-l] [-j N] checklist
+|   finddup [-l] [-j N] -r dir...
 |
 |  where checklist is the name of a file containing filenames to
 |  be checked, such as produced by "find . -type f -print >file"
-|  returns a list of linked and duplicated files.
+|  returns a list of linked and duplicated files. With -r the
+|  files are found by walking the named directories instead.
 |
 |  If the -l option is used the hard links will not be displayed.
+|  With -j N the CRCs are computed, and the directories walked,
+|  on N threads at once.
 \***************************************************************/
 
 #include <stdio.h>
@@ -26,6 +30,9 @@
 #include <string.h>
 #include <stdint.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #include "finddup.h"
 
 /* parameters */
@@ -33,37 +40,70 @@
 
 /* constants */
 #define EOS		((char) '\0')	/* end of string */
-#define FL_CRC	0x0001			/* flag if CRC valid */
-#define FL_DUP	0x0002			/* files are duplicates */
-#define FL_LNK	0x0004			/* file is a link */
+#define FL_CRC	0				/* flag if CRC valid */
+#define FL_DUP	1				/* files are duplicates */
+#define FL_LNK	2				/* file is a link */
+#define FL_PART	3				/* CRC is of the ends only */
+#define NFLAGS	4				/* flags, each a bit set over the files */
+
+/* files the list starts with room for, doubled when full */
+#define MINFILES	1024
+
+/* bytes at each end of a file in its first CRC */
+#define PARTLEN	((off_t) 16384)
+
+/* files compared at once by fullcmp, and the block read from each */
+#define MAXWAY	32
+#define CMPBUF	65536
+#define CMPALIGN	4096
 
 /* macros */
 #ifdef DEBUG
 #define debug(X) if (DebugFlg) printf X
-#define OPTSTR	"lhd"
+#define OPTSTR	"lhdj:rc:"
 #else
 #define debug(X)
-#define OPTSTR	"lh"
+#define OPTSTR	"lhj:rc:"
 #endif
-#define SORT qsort((char *)filelist, n_files, sizeof(filedesc), comp1);
-#define GetFlag(x,f) ((filelist[x].flags & (f)) != 0)
-#define SetFlag(x,f) (filelist[x].flags |= (f))
+#define SORT sortgroups();
+#define FLBIT(x) ((uint64_t) 1 << ((x) & 63))
+#define GetFlag(x,f) ((filelist.flags[f][(x) >> 6] & FLBIT(x)) != 0)
+#define SetFlag(x,f) (filelist.flags[f][(x) >> 6] |= FLBIT(x))
+#define ClrFlag(x,f) (filelist.flags[f][(x) >> 6] &= ~FLBIT(x))
+#define IsPart(x,part) ((part) > 0 && filelist.length[x] > 2 * (part))
+#define NSEC(ts) ((int64_t) (ts).tv_sec * 1000000000 + (ts).tv_nsec)
+#define CMP(a,b) ((a) < (b) ? -1 : (a) > (b))
+#define SameFile(x,y) (filelist.device[x] == filelist.device[y] \
+	&& filelist.inode[x] == filelist.inode[y])
 
+/*
+ * the files, an array for each field, so that a scan reads only the
+ * fields it tests, and the flags a bit per file; file x is entry x of
+ * every array
+ */
 typedef struct {
-	off_t length;				/* file length */
-	unsigned long crc32;		/* CRC for same length */
-	dev_t device;				/* physical device # */
-	ino_t inode;				/* inode for link detect */
-	off_t nameloc;				/* name loc in names file */
-	char flags;					/* flags for compare */
-} filedesc;
-
-filedesc *filelist;				/* master sorted list of files */
+	off_t *length;				/* file length */
+	uint32_t *crc32;			/* CRC for same length */
+	dev_t *device;				/* physical device # */
+	ino_t *inode;				/* inode for link detect */
+	off_t *nameloc;				/* name loc in the name table */
+	int64_t *mtime, *ctime;		/* times in ns, only for the CRC cache */
+	uint64_t *flags[NFLAGS];	/* flags for compare */
+} filecols;
+
+filecols filelist;				/* master sorted list of files */
 long n_files = 0;				/* # files in the array */
 long max_files = 0;				/* entries allocated in the array */
 int linkflag = 1;				/* show links */
+int njobs = 1;					/* threads for the CRC scan and walk */
+int walkflag = 0;				/* walk directories for the files */
+int zl_hdr = 1;					/* need header for zero-length files list */
+char *cachefile = NULL;			/* file of CRCs kept between runs */
 int DebugFlg = 0;				/* inline debug flag */
 FILE *namefd;					/* file for names */
+char *nametab;					/* the names of the files in the list */
+size_t namelen = 0;				/* bytes used in the name table */
+size_t maxnamelen = 0;			/* bytes allocated for the name table */
 extern int
 	opterr,						/* error control flag */
 	optind;						/* index for next arg */
@@ -73,12 +113,17 @@ static char *HelpMsg[] = {
 	"Calling sequence:",
     "",
 	"  finddup [options] list",
+	"  finddup [options] -r dir...",
 	"",
 	"where list is a list of files to check, such as generated",
-	"by \"find . -type f -print > file\"",
+	"by \"find . -type f -print > file\", or with -r the files",
+	"are found under the named directories",
 	"",
 	"Options:",
 	"  -l - don't list hard links",
+	"  -j N - compute CRCs, and walk directories, on N threads",
+	"  -r - walk the named directories for the files",
+	"  -c FILE - keep the CRCs in FILE for the next run",
 #ifdef DEBUG
 	"  -d - debug (must compile with DEBUG)"
 #endif /* ?DEBUG */
@@ -86,12 +131,27 @@ static char *HelpMsg[] = {
 static int HelpLen = sizeof(HelpMsg)/sizeof(char *);
 
 
-int comp1();					/* compare two filedesc's */
+int comp1();					/* compare two files by index */
+void group1();					/* group the files by length */
+static void sortgroups();		/* sort each group of a length */
 void scan1();					/* make the CRC scan */
 void scan2();					/* do full compare if needed */
 void scan3();					/* print the results */
 uint32_t get_crc();				/* get crc32 on a file */
 char *getfn();					/* get a filename by index */
+static off_t addname();			/* add a name to the name table */
+static void addfile();			/* add a file to the list */
+static void growfiles();		/* make room for more files */
+static void permute();			/* reorder files by a list of indexes */
+static void movefile();			/* move a file back, shifting the rest */
+static long getcands();			/* list the files needing a CRC */
+static void getcrcs();			/* get a CRC for the listed files */
+static void setcrc();			/* set the CRC of a file */
+static char *candfn();			/* get a CRC candidate's filename */
+static int cmpopen();			/* open a file for fullcmp */
+static ssize_t cmpread();		/* read a block for fullcmp */
+
+static long *candlist;			/* files needing a CRC, in order */
 
 
 int finddup_main(argc, argv)
@@ -102,10 +162,7 @@ char *argv[];
 	struct stat statbuf;
 	int ch;
 	int firsterr = 0;			/* flag on 1st error for format */
-	int firsttrace = 0;			/* flag for 1st trace output */
-	off_t loc;            		/* location of name in the file */
-	int zl_hdr = 1;				/* need header for zero-length files list */
-	filedesc *curptr;			/* pointer to current storage loc */
+	long loc;					/* index of a file in the list */
 	int arg = 0;				/* integer representation of optional argument*/
 	//array of long options
 	static struct option long_options[] =
@@ -113,6 +170,9 @@ char *argv[];
 			{"help", no_argument, 0, 'h'},
 			{"no-links", no_argument, 0, 'l'},
 			{"debug", optional_argument, 0, 'd'},
+			{"jobs", required_argument, 0, 'j'},
+			{"recurse", no_argument, 0, 'r'},
+			{"cache", required_argument, 0, 'c'},
 			{0, 0, 0, 0}
 		};
 
@@ -123,6 +183,19 @@ char *argv[];
 		case 'l': /* set link flag */
 			linkflag = 0;
 			break;
+		case 'j': /* threads for the CRC scan */
+			njobs = atoi(optarg);
+			if (njobs < 1) {
+				fprintf(stderr, "Bad number of jobs %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'r': /* walk directories */
+			walkflag = 1;
+			break;
+		case 'c': /* CRC cache */
+			cachefile = optarg;
+			break;
 #ifdef DEBUG
 		if(optarg != 0){
 			arg = atoi(optarg);
@@ -152,54 +225,30 @@ char *argv[];
 	argv += (optind-1);
 
 	/* check for filename given, and open it */
-	if (argc != 2) {
-		fprintf(stderr, "Needs name of file with filenames\n");
+	if (walkflag ? argc < 2 : argc != 2) {
+		fprintf(stderr, walkflag ? "Needs names of directories\n"
+			: "Needs name of file with filenames\n");
 		exit(1);
 	}
-	namefd = fopen(argv[1], "r");
-	if (namefd == NULL) {
-		perror("Can't open names file");
-		exit(1);
+	if (!walkflag) {
+		namefd = fopen(argv[1], "r");
+		if (namefd == NULL) {
+			perror("Can't open names file");
+			exit(1);
+		}
 	}
 
 	/* start the list of name info's */
-	filelist = (filedesc *) malloc(50 * sizeof(filedesc));
-	if (filelist == NULL) {
-		perror("Can't start files vector");
-		exit(1);
-	}
-	//initialize filelist
-	for (int i = 0; i < 50; i++){
-		filelist[i].length = 0;
-		filelist[i].crc32 = 0;
-		filelist[i].device = 0;
-		filelist[i].inode = 0;
-		filelist[i].nameloc = 0;
-		filelist[i].flags = 0;
-	}
-
-	/* finish the pointers */
-	max_files = 50;
-	debug(("First vector allocated @ %08lx, size %lu bytes\n",
-		(long) filelist, 50*sizeof(filedesc)
-	));
+	growfiles();
+	debug(("First vectors allocated, for %ld files\n", max_files));
 	fprintf(stderr, "build list...");
 
 	/* this is the build loop */
 	static size_t n = 0;
-	while (loc = ftell(namefd), getline(&curfile, &n, namefd) != -1) {
-		/* check for room in the buffer */
-		if (n_files == max_files) {
-			/* allocate more space */
-			max_files += 50;
-			filelist =
-				(filedesc *) realloc(filelist, (max_files)*sizeof(filedesc));
-			if (filelist == NULL) {
-				perror("Out of memory!");
-				exit(1);
-			}
-			debug(("Got more memory!\n"));
-		}
+	if (walkflag) {
+		walk_dirs(argv + 1, argc - 1, njobs, addfile);
+	}
+	while (!walkflag && getline(&curfile, &n, namefd) != -1) {
 		curfile[strlen(curfile)-1] = EOS;
 
 		/* add the data for this one */
@@ -215,35 +264,20 @@ char *argv[];
 			continue;
 		}
 
-		/* check for zero length files */
-		if ( statbuf.st_size == 0) {
-			if (zl_hdr) {
-				zl_hdr = 0;
-				printf("Zero length files:\n\n");
-			}
-			printf("%s\n", curfile);
-			continue;
-		}
-
-		curptr = filelist + n_files++;
-		curptr->nameloc = loc;
-		curptr->length = statbuf.st_size;
-		curptr->device = statbuf.st_dev;
-		curptr->inode = statbuf.st_ino;
-		curptr->flags = 0;
-		debug(("%cName[%li] %s, size %ld, inode %lu\n",
-			(firsttrace++ == 0 ? '\n' : '\r'), n_files, curfile,
-			(long) statbuf.st_size, statbuf.st_ino
-		));
+		addfile(curfile, &statbuf);
 	}
+	/* the names are all in the name table now */
+	if (!walkflag) fclose(namefd);
 
-	/* sort the list by size, device, and inode */
+	/* group the list by size, and sort by device, and inode */
 	fprintf(stderr, "sort...");
-	SORT;
+	group1();
 
 	/* make the first scan for equal lengths */
 	fprintf(stderr, "scan1...");
+	if (cachefile) hcache_open(cachefile, PARTLEN);
 	scan1();
+	if (cachefile) hcache_save();
 
 	/* make the second scan for dup CRC also */
 	fprintf(stderr, "scan2...");
@@ -253,11 +287,11 @@ char *argv[];
 
 #ifdef DEBUG
 	for (loc = 0; DebugFlg > 1 && loc < n_files; ++loc) {
-		curptr = filelist + loc;
-		printf("%8ld %08lx %6lu %6lu %02x\n",
-			curptr->length, curptr->crc32,
-			curptr->device, curptr->inode,
-			curptr->flags
+		printf("%8ld %08lx %6lu %6lu %d%d%d%d\n",
+			(long) filelist.length[loc], (unsigned long) filelist.crc32[loc],
+			(unsigned long) filelist.device[loc], (unsigned long) filelist.inode[loc],
+			GetFlag(loc, FL_CRC), GetFlag(loc, FL_DUP),
+			GetFlag(loc, FL_LNK), GetFlag(loc, FL_PART)
 		);
 	}
 #endif
@@ -269,73 +303,474 @@ char *argv[];
 	exit(0);
 }
 
-/* comp1 - compare two values */
+/* addfile - add a regular file to the list, or note it if empty */
+
+static void
+addfile(curfile, sp)
+char *curfile;
+struct stat *sp;
+{
+	static int firsttrace = 0;	/* flag for 1st trace output */
+	long ix;
+	int f;
+
+	/* check for zero length files */
+	if (sp->st_size == 0) {
+		if (zl_hdr) {
+			zl_hdr = 0;
+			printf("Zero length files:\n\n");
+		}
+		printf("%s\n", curfile);
+		return;
+	}
+
+	/* check for room in the buffer */
+	if (n_files == max_files) {
+		growfiles();
+		debug(("Got more memory!\n"));
+	}
+
+	ix = n_files++;
+	filelist.nameloc[ix] = addname(curfile);
+	filelist.length[ix] = sp->st_size;
+	filelist.crc32[ix] = 0;
+	filelist.device[ix] = sp->st_dev;
+	filelist.inode[ix] = sp->st_ino;
+	if (cachefile) {
+		filelist.mtime[ix] = NSEC(sp->st_mtim);
+		filelist.ctime[ix] = NSEC(sp->st_ctim);
+	}
+	for (f = 0; f < NFLAGS; ++f) {
+		ClrFlag(ix, f);
+	}
+	debug(("%cName[%li] %s, size %ld, inode %lu\n",
+		(firsttrace++ == 0 ? '\n' : '\r'), n_files, curfile,
+		(long) sp->st_size, sp->st_ino
+	));
+}
+
+/*
+ * growfiles - start the list, or double the room in it, so that a list
+ * of n files is copied no more than log2(n) times as it is built
+ */
+
+#define GROW(col,n) \
+	if ((col = realloc(col, (n) * sizeof(*col))) == NULL) goto oom;
+
+static void
+growfiles()
+{
+	int f;
+
+	/* a multiple of 64, so the flags fill whole words */
+	max_files = max_files ? 2 * max_files : MINFILES;
+	GROW(filelist.length, max_files)
+	GROW(filelist.crc32, max_files)
+	GROW(filelist.device, max_files)
+	GROW(filelist.inode, max_files)
+	GROW(filelist.nameloc, max_files)
+	if (cachefile) {
+		GROW(filelist.mtime, max_files)
+		GROW(filelist.ctime, max_files)
+	}
+	for (f = 0; f < NFLAGS; ++f) {
+		GROW(filelist.flags[f], max_files / 64)
+	}
+	return;
+
+oom:
+	perror("Out of memory!");
+	exit(1);
+}
+#undef GROW
+
+/*
+ * permute - put the n files listed by index in order at the front of
+ * the list, each field a pass over its own array
+ */
+
+#define PERMUTE(col,type) \
+	if (col) { \
+		for (k = 0; k < n; ++k) ((type *) tmp)[k] = col[order[k]]; \
+		memcpy(col, tmp, n * sizeof(type)); \
+	}
+
+static void
+permute(order, n)
+long *order;
+long n;
+{
+	void *tmp;
+	uint64_t *bits;
+	long k;
+	int f;
+
+	/* room for the widest field */
+	tmp = malloc((n ? n : 1) * sizeof(int64_t));
+	if (tmp == NULL) {
+		perror("Out of memory!");
+		exit(1);
+	}
+	PERMUTE(filelist.length, off_t)
+	PERMUTE(filelist.crc32, uint32_t)
+	PERMUTE(filelist.device, dev_t)
+	PERMUTE(filelist.inode, ino_t)
+	PERMUTE(filelist.nameloc, off_t)
+	PERMUTE(filelist.mtime, int64_t)
+	PERMUTE(filelist.ctime, int64_t)
+	bits = (uint64_t *) tmp;
+	for (f = 0; f < NFLAGS; ++f) {
+		memset(bits, 0, (n + 63) / 64 * sizeof(uint64_t));
+		for (k = 0; k < n; ++k) {
+			if (GetFlag(order[k], f)) bits[k >> 6] |= FLBIT(k);
+		}
+		memcpy(filelist.flags[f], bits, (n + 63) / 64 * sizeof(uint64_t));
+	}
+	free(tmp);
+}
+#undef PERMUTE
+
+/* movefile - move file from back to file to, shifting those between up one */
+
+#define MOVE(col,type) \
+	if (col) { \
+		type t = col[from]; \
+		memmove(col + to + 1, col + to, (from - to) * sizeof(*col)); \
+		col[to] = t; \
+	}
+
+static void
+movefile(from, to)
+long from, to;
+{
+	long ix;
+	int f, bit;
+
+	MOVE(filelist.length, off_t)
+	MOVE(filelist.crc32, uint32_t)
+	MOVE(filelist.device, dev_t)
+	MOVE(filelist.inode, ino_t)
+	MOVE(filelist.nameloc, off_t)
+	MOVE(filelist.mtime, int64_t)
+	MOVE(filelist.ctime, int64_t)
+	for (f = 0; f < NFLAGS; ++f) {
+		bit = GetFlag(from, f);
+		for (ix = from; ix > to; --ix) {
+			if (GetFlag(ix-1, f)) SetFlag(ix, f); else ClrFlag(ix, f);
+		}
+		if (bit) SetFlag(to, f); else ClrFlag(to, f);
+	}
+}
+#undef MOVE
+
+/*
+ * group1 - keep only the files which share a length with another, as
+ * only they can be duplicates or links, in groups of a length in order
+ * of length, each group sorted (see comp1). The files are counted by
+ * length in a hash table and moved to the place of their group, so that
+ * only the lengths of the groups, and each group, are sorted.
+ */
+
+struct lenslot {
+	off_t length;
+	long count;					/* files of the length, 0 if free */
+	long next;					/* where its next file goes */
+};
+
+static int
+complen(p1, p2)
+char *p1, *p2;
+{
+	return CMP((*(struct lenslot **)p1)->length,
+		(*(struct lenslot **)p2)->length);
+}
+
+void
+group1()
+{
+	struct lenslot *tab, *sp, **groups;
+	unsigned long slots, mask, h;
+	long ix, ngroups = 0, total = 0;
+	long *order;
+
+	for (slots = 16; slots < 2 * (unsigned long) n_files; slots *= 2)
+		;
+	mask = slots - 1;
+	tab = (struct lenslot *) calloc(slots, sizeof(struct lenslot));
+	groups = (struct lenslot **) malloc((n_files / 2 + 1) * sizeof(*groups));
+	if (tab == NULL || groups == NULL) {
+		perror("Out of memory!");
+		exit(1);
+	}
+
+	/* count the files of each length */
+	for (ix = 0; ix < n_files; ++ix) {
+		h = (unsigned long) filelist.length[ix] * 0x9e3779b97f4a7c15UL;
+		for (sp = tab + ((h ^ h >> 29) & mask);
+			sp->count != 0 && sp->length != filelist.length[ix];
+			sp = tab + ((sp - tab + 1) & mask)
+		) ;
+		sp->length = filelist.length[ix];
+		if (++sp->count == 2) {
+			groups[ngroups++] = sp;
+		}
+	}
+
+	/* place the groups in order of length */
+	qsort((char *)groups, ngroups, sizeof(*groups), complen);
+	for (ix = 0; ix < ngroups; ++ix) {
+		groups[ix]->next = total;
+		total += groups[ix]->count;
+	}
+
+	/* and move the files of each to its place, in the order listed */
+	order = (long *) malloc((total ? total : 1) * sizeof(long));
+	if (order == NULL) {
+		perror("Out of memory!");
+		exit(1);
+	}
+	for (ix = 0; ix < n_files; ++ix) {
+		h = (unsigned long) filelist.length[ix] * 0x9e3779b97f4a7c15UL;
+		for (sp = tab + ((h ^ h >> 29) & mask);
+			sp->length != filelist.length[ix];
+			sp = tab + ((sp - tab + 1) & mask)
+		) ;
+		if (sp->count > 1) {
+			order[sp->next++] = ix;
+		}
+	}
+	debug(("\n%ld of %ld files in %ld groups\n", total, n_files, ngroups));
+	free(groups);
+	free(tab);
+	permute(order, total);
+	free(order);
+	n_files = total;
+
+	SORT;
+}
+
+/*
+ * sortgroups - sort each group of files of a length (see comp1), as a
+ * list of indexes, and then reorder the files by it
+ */
+
+static void
+sortgroups()
+{
+	long ix, end, *order;
+
+	order = (long *) malloc((n_files ? n_files : 1) * sizeof(long));
+	if (order == NULL) {
+		perror("Out of memory!");
+		exit(1);
+	}
+	for (ix = 0; ix < n_files; ++ix) {
+		order[ix] = ix;
+	}
+	for (ix = 0; ix < n_files; ix = end) {
+		for (end = ix+1;
+			end < n_files && filelist.length[end] == filelist.length[ix];
+			++end
+		) ;
+		if (end - ix > 1) {
+			qsort((char *)(order + ix), end - ix, sizeof(long), comp1);
+		}
+	}
+	permute(order, n_files);
+	free(order);
+}
+
+/* comp1 - compare two files, given pointers to their indexes */
 int
 comp1(p1, p2)
 char *p1, *p2;
 {
-	register filedesc *p1a = (filedesc *)p1, *p2a = (filedesc *)p2;
+	register long i1 = *(long *)p1, i2 = *(long *)p2;
 	register int retval = 0;
 
+	/* not by subtraction, which overflows an int */
+	if (retval == 0) {
+		retval = CMP(filelist.length[i1], filelist.length[i2]);
+	}
 	if (retval == 0) {
-		retval = p1a->length - p2a->length;
+		retval = CMP(filelist.crc32[i1], filelist.crc32[i2]);
 	}
 	if (retval == 0) {
-		retval = p1a->crc32 - p2a->crc32;
+		retval = CMP(filelist.device[i1], filelist.device[i2]);
 	}
 	if (retval == 0) {
-		retval = p1a->device - p2a->device;
+		retval = CMP(filelist.inode[i1], filelist.inode[i2]);
 	}
 	if (retval == 0) {
-		retval = p1a->inode - p2a->inode;
+		/* links in the order listed, however qsort works */
+		retval = CMP(filelist.nameloc[i1], filelist.nameloc[i2]);
 	}
 
 	return retval;
 }
 
-/* scan1 - get a CRC32 for files of equal length */
+/*
+ * scan1 - get a CRC32 for files of equal length, in two stages: first of
+ * the ends of each file, then of the whole of those whose ends match
+ * another's, so that files which differ early are read only at the ends
+ */
 
 void
 scan1() {
-	int ix, needsort = 0;
-
-	for (ix = 1; ix <= n_files; ++ix) {
-		if (filelist[ix-1].length == filelist[ix].length) {
-			/* get a CRC for each */
-			if (! GetFlag(ix-1, FL_CRC)) {
-				filelist[ix-1].crc32 = get_crc(ix-1);
-				SetFlag(ix-1, FL_CRC);
-			}
-			if (! GetFlag(ix, FL_CRC)) {
-				filelist[ix].crc32 = get_crc(ix);
-				SetFlag(ix, FL_CRC);
+	long ncand;
+
+	candlist = (long *) malloc(n_files * sizeof(long));
+	if (n_files > 0 && candlist == NULL) {
+		perror("Out of memory!");
+		exit(1);
+	}
+
+	ncand = getcands(0);
+	if (ncand > 0) {
+		getcrcs(ncand, PARTLEN);
+		SORT;
+		ncand = getcands(FL_PART);
+		if (ncand > 0) {
+			getcrcs(ncand, (off_t) 0);
+			SORT;
+		}
+	}
+	free(candlist);
+}
+
+/*
+ * getcands - list the files which share a length with a neighbor, and
+ * if flag is given, which have it and share the CRC too
+ */
+
+static long
+getcands(flag)
+int flag;
+{
+	long ix, ncand = 0;
+
+	for (ix = 1; ix < n_files; ++ix) {
+		if (filelist.length[ix-1] == filelist.length[ix]
+			&& (flag == 0 || (GetFlag(ix, flag)
+				&& filelist.crc32[ix-1] == filelist.crc32[ix]))
+		) {
+			if (ncand == 0 || candlist[ncand-1] != ix-1) {
+				candlist[ncand++] = ix-1;
 			}
-			needsort = 1;
+			candlist[ncand++] = ix;
+		}
+	}
+	return ncand;
+}
+
+/*
+ * getcrcs - get a CRC for each listed file, from the cache if it has it
+ * and on the worker threads if asked, of the ends only if part is not 0
+ * (see crc_file)
+ */
+
+static void
+getcrcs(ncand, part)
+long ncand;
+off_t part;
+{
+	long ix, k, nmiss;
+	uint32_t *crcs = NULL;
+	int *errs = NULL;
+	uint32_t crc;
+
+	/* take what the cache has, and list the rest */
+	for (k = nmiss = 0; k < ncand; ++k) {
+		ix = candlist[k];
+		if (cachefile && hcache_get(filelist.device[ix], filelist.inode[ix],
+			filelist.length[ix], filelist.mtime[ix], filelist.ctime[ix],
+			IsPart(ix, part), &crc)
+		) {
+			setcrc(ix, part, crc);
+		}
+		else {
+			candlist[nmiss++] = ix;
+		}
+	}
+	ncand = nmiss;
+
+	if (njobs > 1 && ncand > 1) {
+		crcs = (uint32_t *) malloc(ncand * sizeof(uint32_t));
+		errs = (int *) malloc(ncand * sizeof(int));
+		if (crcs == NULL || errs == NULL
+			|| hash_files(ncand, njobs, part, candfn, crcs, errs)
+		) {
+			free(crcs);
+			free(errs);
+			crcs = NULL;
+			errs = NULL;
+		}
+	}
+	for (k = 0; k < ncand; ++k) {
+		ix = candlist[k];
+		if (crcs == NULL) {
+			crc = get_crc(ix, part);
+		}
+		else if (errs[k] == 0) {
+			crc = crcs[k];
+		}
+		else {
+			/* first failure in list order, as a serial scan would */
+			fprintf(stderr, "Can't read file %s\n", getfn(ix));
+			exit(1);
+		}
+		setcrc(ix, part, crc);
+		if (cachefile) {
+			hcache_put(filelist.device[ix], filelist.inode[ix],
+				filelist.length[ix], filelist.mtime[ix], filelist.ctime[ix],
+				IsPart(ix, part), crc);
 		}
 	}
+	free(crcs);
+	free(errs);
+}
+
+/* setcrc - set the CRC of a file, of the ends only if part is not 0 */
 
-	if (needsort) SORT;
+static void
+setcrc(ix, part, crc)
+long ix;
+off_t part;
+uint32_t crc;
+{
+	filelist.crc32[ix] = crc;
+	SetFlag(ix, FL_CRC);
+	if (IsPart(ix, part))
+		SetFlag(ix, FL_PART);
+	else
+		ClrFlag(ix, FL_PART);
+}
+
+/* candfn - get the filename of the k'th CRC candidate */
+
+static char *
+candfn(k)
+long k;
+{
+	return getfn(candlist[k]);
 }
 
 /* scan2 - full compare if CRC is equal */
 
 void
 scan2() {
-	int ix, ix2, lastix;
+	int ix, ix2, lastix, end;
 	int inmatch;				/* 1st filename has been printed */
 	int need_hdr = 1;			/* Need a hdr for the hard link list */
-	int lnkmatch;				/* flag for matching links */
-	register filedesc *p1, *p2;
-	filedesc wkdesc;
+	char *same = NULL;			/* files matching the first of a group */
+	int maxsame = 0;			/* size of same */
+	int nway;					/* files compared at once */
 
 	/* mark links and output before dup check */
 	for (ix = 0; ix < n_files; ix = ix2) {
-		p1 = filelist + ix;
-		for (ix2 = ix+1, p2 = p1+1, inmatch = 0;
-			ix2 < n_files
-				&& p1->device == p2->device
-				&& p1->inode == p2->inode;
-			++ix2, ++p2
+		for (ix2 = ix+1, inmatch = 0;
+			ix2 < n_files && SameFile(ix, ix2);
+			++ix2
 		) {
 			SetFlag(ix2, FL_LNK);
 			if (linkflag) {
@@ -356,36 +791,39 @@ scan2() {
 
 	/* now really scan for duplicates */
 	for (ix = 0; ix < n_files; ix = lastix) {
-		p1 = filelist + ix;
-		for (lastix = ix2 = ix+1, p2 = p1+1, lnkmatch = 1;
-			ix2 < n_files
-				&& p1->length == p2->length
-				&& p1->crc32 == p2->crc32;
-			++ix2, ++p2
-		) {
-			if ((GetFlag(ix2, FL_LNK) && lnkmatch)
-				|| fullcmp(ix, ix2) == 0
-			) {
+		for (end = ix+1;
+			end < n_files
+				&& filelist.length[ix] == filelist.length[end]
+				&& filelist.crc32[ix] == filelist.crc32[end];
+			++end
+		) ;
+
+		/* compare the rest of the group with the first, MAXWAY at a time */
+		if (end - ix > maxsame) {
+			maxsame = end - ix;
+			same = (char *) realloc(same, maxsame);
+			if (same == NULL) {
+				perror("Out of memory!");
+				exit(1);
+			}
+		}
+		for (ix2 = ix+1; ix2 < end; ix2 += nway) {
+			nway = end - ix2 < MAXWAY ? end - ix2 : MAXWAY;
+			fullcmp(ix, ix2, nway, same + (ix2 - ix));
+		}
+
+		for (lastix = ix2 = ix+1; ix2 < end; ++ix2) {
+			if (same[ix2 - ix]) {
 				SetFlag(ix2, FL_DUP);
 				/* move if needed */
 				if (lastix != ix2) {
-					int n1, n2;
-
 					debug(("\n  swap %d and %d", lastix, ix2));
-					wkdesc = filelist[ix2];
-					for (n1 = ix2; n1 > lastix; --n1) {
-						filelist[n1] = filelist[n1-1];
-					}
-					filelist[lastix++] = wkdesc;
+					movefile(ix2, lastix++);
 				}
-				lnkmatch = 1;
-			}
-			else {
-				/* other links don't match */
-				lnkmatch = 0;
 			}
 		}
 	}
+	free(same);
 }
 
 /* scan3 - output dups */
@@ -426,59 +864,23 @@ scan3()
 	}
 }
 
-/* get_crc - get a CRC32 for a file */
+/* get_crc - get a CRC32 for a file (see crc_file) */
 
 uint32_t
-get_crc(ix)
-int ix;
+get_crc(ix, part)
+long ix;
+off_t part;
 {
-	FILE *fp;
-	//register unsigned long val1 = 0x90909090, val2 = 0xeaeaeaea;
-	//register int carry;
-	//char ch;
 	char *fname;
-	char *content = NULL;
-	//char *currline = NULL;
-	//size_t n;
+	uint32_t crc;
 
 	/* open the file */
 	fname = getfn(ix);
-	//fseek(namefd, filelist[ix].nameloc, 0);
-	//fgets(fname, MAXFN, namefd);
-	//fname[strlen(fname)-1] = EOS;
 	debug(("\nCRC start - %s ", fname));
-	if ((fp = fopen(fname, "r")) == NULL) {
+	if (crc_file(fname, part, &crc)) {
 		fprintf(stderr, "Can't read file %s\n", fname);
 		exit(1);
 	}
-
-	/*if (getline(&content, &n, fp) != -1) {
-		currline = content + n;
-	}
-	while(getline(&currline, &n, fp) != -1){
-		currline += n;
-	}*/
-	fseek(fp, 0, SEEK_END);
-	int fsize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	content = (char *) malloc(fsize + 1);
-	content[fsize] = '\0';
-	fread(content, 1, fsize, fp);
-	fclose(fp);
-
-	/* build the CRC values */
-	/*while ((ch = fgetc(fp)) != EOF) {
-		carry = (val1 & 0x8000000) != 0;
-		val1 = ((val1 << 1) ^ ch) + carry;
-		val2 += ch << (ch & 003);
-	}
-	debug(("v1: %08lx v2: %08lx ", val1, val2));
-
-	return ((val1 & 0xffff) << 12) ^ (val2 && 0xffffff);*/
-
-	//printf("%d\n",rc_crc32(0, content, strlen(content)));
-	uint32_t crc = rc_crc32(0, content, strlen(content));
-	free(content);
 	return crc;
 }
 
@@ -488,55 +890,156 @@ char *
 getfn(ix)
 off_t ix;
 {
-	//static char fnbuf[MAXFN];
-	static char *fnbuf;
-	static size_t n = 0;
+	return nametab + filelist.nameloc[ix];
+}
+
+/*
+ * addname - add a name to the name table, which holds all of the names
+ * one after another, and return its location there
+ */
 
-	fseek(namefd, filelist[ix].nameloc, 0);
-	//fgets(fnbuf, MAXFN, namefd);
-	getline(&fnbuf, &n, namefd);
-	fnbuf[strlen(fnbuf)-1] = EOS;
+static off_t
+addname(name)
+char *name;
+{
+	size_t len = strlen(name) + 1;
+	off_t loc = namelen;
 
-	return fnbuf;
+	if (namelen + len > maxnamelen) {
+		/* double the table, so names are copied few times */
+		do {
+			maxnamelen = maxnamelen ? 2 * maxnamelen : 4096;
+		} while (namelen + len > maxnamelen);
+		nametab = (char *) realloc(nametab, maxnamelen);
+		if (nametab == NULL) {
+			perror("Out of memory!");
+			exit(1);
+		}
+		debug(("Got more names!\n"));
+	}
+	memcpy(nametab + loc, name, len);
+	namelen += len;
+	return loc;
 }
-
-/* fullcmp - compare two files, bit for bit */
+
+/*
+ * fullcmp - compare a file bit for bit with the n after it from v2,
+ * reading all of them side by side a block at a time, so that each is
+ * read once, and dropping each as soon as it differs. same[k] is set to
+ * 1 if file v2+k is a duplicate of v1, and 0 if not. Links to v1, or to
+ * the file before them, are not read again.
+ */
 
 int
-fullcmp(v1, v2)
-int v1, v2;
+fullcmp(v1, v2, n, same)
+long v1, v2;
+int n;
+char *same;
 {
-	FILE *fp1, *fp2;
-	char *filename;
-	register char ch;
-
-	/* open the files */
-	filename = getfn(v1);
-	fp1 = fopen(filename, "r");
-	if (fp1 == NULL) {
-		fprintf(stderr, "%s: ", filename);
-		perror("can't access for read");
+	static char *bufs;			/* a block for v1 and each of the others */
+	int fds[MAXWAY+1];
+	ssize_t got, got1;
+	long ix;
+	int k, live = 0, count = 0;
+	struct stat statbuf;
+	off_t size;
+
+	if (bufs == NULL
+		&& posix_memalign((void **) &bufs, CMPALIGN, (MAXWAY+1) * CMPBUF)
+	) {
+		perror("Out of memory!");
 		exit(1);
 	}
-	debug(("\nFull compare %s\n         and", filename));
 
-	filename = getfn(v2);
-	fp2 = fopen(filename, "r");
-	if (fp2 == NULL) {
-		fprintf(stderr, "%s: ", filename);
-		perror("can't access for read");
-		exit(1);
+	/* open the files, and check the lengths */
+	fds[0] = cmpopen(v1, &statbuf);
+	size = statbuf.st_size;
+	debug(("\nFull compare %s with %d", getfn(v1), n));
+	for (k = 0; k < n; ++k) {
+		ix = v2 + k;
+		fds[k+1] = -1;
+		same[k] = 0;
+		if (SameFile(ix, v1)) {
+			same[k] = 1;
+		}
+		else if (k > 0 && SameFile(ix, ix-1)) {
+			same[k] = 2;		/* as the one before */
+		}
+		else {
+			fds[k+1] = cmpopen(ix, &statbuf);
+			if (statbuf.st_size == size) {
+				same[k] = 1;
+				++live;
+			}
+		}
 	}
-	debug(("%s", filename));
 
 	/* now do the compare */
-	while ((ch = getc(fp1)) != EOF) {
-		if (ch - getc(fp2)) break;
+	while (live > 0) {
+		got1 = cmpread(fds[0], bufs, v1);
+		for (k = 0; k < n; ++k) {
+			if (fds[k+1] < 0 || !same[k]) continue;
+			got = cmpread(fds[k+1], bufs + (k+1) * CMPBUF, v2 + k);
+			if (got != got1 || memcmp(bufs, bufs + (k+1) * CMPBUF, got1)) {
+				same[k] = 0;
+				--live;
+			}
+		}
+		if (got1 == 0) break;
 	}
 
 	/* close files and return value */
-	fclose(fp1);
-	fclose(fp2);
-	debug(("\n      return %d", !(ch == EOF)));
-	return (!(ch == EOF));
+	for (k = 0; k <= n; ++k) {
+		if (fds[k] >= 0) close(fds[k]);
+	}
+	for (k = 0; k < n; ++k) {
+		if (same[k] == 2) same[k] = same[k-1];
+		count += same[k];
+	}
+	debug(("\n      return %d", count));
+	return count;
+}
+
+/* cmpopen - open a file by index for fullcmp */
+
+static int
+cmpopen(ix, sp)
+long ix;
+struct stat *sp;
+{
+	char *filename = getfn(ix);
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, sp)) {
+		fprintf(stderr, "%s: ", filename);
+		perror("can't access for read");
+		exit(1);
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return fd;
+}
+
+/* cmpread - read the next block of a file for fullcmp, short only at EOF */
+
+static ssize_t
+cmpread(fd, buf, ix)
+int fd;
+char *buf;
+long ix;
+{
+	ssize_t got, total = 0;
+
+	while (total < CMPBUF) {
+		got = read(fd, buf + total, CMPBUF - total);
+		if (got < 0) {
+			if (errno == EINTR) continue;
+			fprintf(stderr, "%s: ", getfn(ix));
+			perror("can't read");
+			exit(1);
+		}
+		if (got == 0) break;
+		total += got;
+	}
+	return total;
 }
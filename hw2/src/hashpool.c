@@ -0,0 +1,200 @@
+/****************************************************************\
+|  hashpool.c - compute the CRC32 of files on a pool of threads
+|----------------------------------------------------------------
+|  The names of the files are fed by the calling thread, in order,
+|  through a bounded queue to the workers, so that no more than a
+|  few names are held at once however many files are hashed. Each
+|  result is stored by the position of its name in the order fed,
+|  so the results do not depend on which worker hashed which file.
+\***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "finddup.h"
+
+#define QPERJOB	4				/* queue slots per worker */
+#define CRCBUF	65536			/* bytes read at a time for a CRC */
+
+struct hashq {
+	pthread_mutex_t lock;
+	pthread_cond_t notfull;		/* a slot has been freed */
+	pthread_cond_t notempty;	/* a name has been queued, or done */
+	long *slot;					/* position of each queued name */
+	char **name;				/* the queued names */
+	int cap, head, count;
+	int done;					/* no more names will be queued */
+	off_t part;					/* bytes hashed at each end, or 0 */
+	uint32_t *crcs;
+	int *errs;
+};
+
+/*
+ * crc_range - add len bytes of a file at off to a CRC32, or the rest of
+ * the file if len is negative, a buffer at a time, so the memory used
+ * is the same for a file of any size
+ */
+
+static int
+crc_range(int fd, off_t off, off_t len, uint32_t *crcp)
+{
+	char buf[CRCBUF];
+	ssize_t got;
+
+	while (len != 0) {
+		got = pread(fd, buf, len < 0 || len > CRCBUF ? CRCBUF : len, off);
+		if (got < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (got == 0) break;
+		*crcp = crc32_fast(*crcp, buf, got);
+		off += got;
+		if (len > 0) len -= got;
+	}
+	return 0;
+}
+
+/*
+ * crc_file - get a CRC32 for a file by name: of the first and last part
+ * bytes only if part is not 0 and the file is longer than both, and of
+ * the whole file otherwise
+ */
+
+int
+crc_file(const char *fname, off_t part, uint32_t *crcp)
+{
+	struct stat statbuf;
+	uint32_t crc = 0;
+	int fd, err, ret;
+
+	if ((fd = open(fname, O_RDONLY)) < 0) {
+		return -1;
+	}
+	if (part > 0 && fstat(fd, &statbuf) == 0 && statbuf.st_size > 2 * part) {
+		/* don't read ahead past the ends */
+		posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+		ret = crc_range(fd, 0, part, &crc);
+		if (ret == 0) {
+			ret = crc_range(fd, statbuf.st_size - part, part, &crc);
+		}
+	}
+	else {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		ret = crc_range(fd, 0, -1, &crc);
+	}
+	err = errno;
+	close(fd);
+	errno = err;
+
+	*crcp = crc;
+	return ret;
+}
+
+/* hash_worker - hash queued files until the queue is drained and done */
+
+static void *
+hash_worker(void *arg)
+{
+	struct hashq *q = arg;
+	long k;
+	char *fname;
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		while (q->count == 0 && !q->done) {
+			pthread_cond_wait(&q->notempty, &q->lock);
+		}
+		if (q->count == 0) {
+			pthread_mutex_unlock(&q->lock);
+			return NULL;
+		}
+		k = q->slot[q->head];
+		fname = q->name[q->head];
+		q->head = (q->head + 1) % q->cap;
+		--q->count;
+		pthread_cond_signal(&q->notfull);
+		pthread_mutex_unlock(&q->lock);
+
+		q->errs[k] = crc_file(fname, q->part, &q->crcs[k]) ? errno : 0;
+		free(fname);
+	}
+}
+
+/* hash_files - get the CRC32 of count files on jobs threads (see crc_file) */
+
+int
+hash_files(long count, int jobs, off_t part, char *(*getname)(long), uint32_t *crcs, int *errs)
+{
+	struct hashq q;
+	pthread_t *tids;
+	int started, tail;
+	long k;
+	char *fname;
+
+	tids = (pthread_t *) malloc(jobs * sizeof(pthread_t));
+	q.cap = jobs * QPERJOB;
+	q.slot = (long *) malloc(q.cap * sizeof(long));
+	q.name = (char **) malloc(q.cap * sizeof(char *));
+	if (tids == NULL || q.slot == NULL || q.name == NULL) {
+		free(tids);
+		free(q.slot);
+		free(q.name);
+		return -1;
+	}
+	q.head = q.count = q.done = 0;
+	q.part = part;
+	q.crcs = crcs;
+	q.errs = errs;
+	pthread_mutex_init(&q.lock, NULL);
+	pthread_cond_init(&q.notfull, NULL);
+	pthread_cond_init(&q.notempty, NULL);
+
+	for (started = 0; started < jobs; ++started) {
+		if (pthread_create(&tids[started], NULL, hash_worker, &q)) break;
+	}
+
+	for (k = 0; k < count; ++k) {
+		if (started == 0) {
+			/* no workers, so hash them here */
+			errs[k] = crc_file(getname(k), part, &crcs[k]) ? errno : 0;
+			continue;
+		}
+		if ((fname = strdup(getname(k))) == NULL) {
+			errs[k] = ENOMEM;
+			continue;
+		}
+		pthread_mutex_lock(&q.lock);
+		while (q.count == q.cap) {
+			pthread_cond_wait(&q.notfull, &q.lock);
+		}
+		tail = (q.head + q.count) % q.cap;
+		q.slot[tail] = k;
+		q.name[tail] = fname;
+		++q.count;
+		pthread_cond_signal(&q.notempty);
+		pthread_mutex_unlock(&q.lock);
+	}
+
+	pthread_mutex_lock(&q.lock);
+	q.done = 1;
+	pthread_cond_broadcast(&q.notempty);
+	pthread_mutex_unlock(&q.lock);
+	while (started > 0) {
+		pthread_join(tids[--started], NULL);
+	}
+
+	pthread_cond_destroy(&q.notempty);
+	pthread_cond_destroy(&q.notfull);
+	pthread_mutex_destroy(&q.lock);
+	free(q.name);
+	free(q.slot);
+	free(tids);
+	return 0;
+}
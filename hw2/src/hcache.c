@@ -0,0 +1,416 @@
+/****************************************************************\
+|  hcache.c - persistent cache of the CRCs of files
+|----------------------------------------------------------------
+|  The cache maps a file, by device and inode, to its CRC and the
+|  CRC of its ends (see crc_file), which are used as long as the
+|  file still has the length, mtime and ctime recorded with them.
+|
+|  The cache file is an open addressing hash table, read through
+|  a read-only mapping. It begins with a header of HC_HDRSIZE
+|  bytes, in the byte order of the host:
+|
+|    magic (32 bits, HC_MAGIC)   version (32 bits, HC_VERSION)
+|    entry size (32 bits)        bytes hashed at each end (32 bits)
+|    slots (64 bits, a power of 2)
+|    entries used (64 bits)
+|
+|  followed by the slots, each an hcent, and free if its flags are
+|  0. A cache that is not of this version and byte order is
+|  ignored, and replaced when saved.
+|
+|  New CRCs are kept in memory and merged into the cache file when
+|  it is saved: under a lock on a ".lock" file beside it, the file
+|  is read again, merged with them, written to a temporary file and
+|  renamed over the cache, so that concurrent runs each add their
+|  CRCs, and a reader always sees a whole cache.
+|
+|  Each entry is stamped with the day (since the epoch, in UTC) it
+|  was last used, by a run that looked the file up or hashed it.
+|  When the cache is saved, entries not used for HC_EXPIRE days are
+|  dropped, so that files which were removed, replaced or are no
+|  longer scanned leave the cache in time, and it does not grow
+|  without bound. A run that only finds CRCs used before today
+|  restamps them, so rewrites the cache at most once a day.
+\***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include "finddup.h"
+
+#define HC_MAGIC	0x46444843	/* "FDHC" */
+#define HC_VERSION	1
+#define HC_HDRSIZE	32
+#define HC_MINSLOTS	1024
+#define HC_EXPIRE	30		/* days an unused entry is kept */
+
+#define HC_FULL		0x0001		/* crc is valid */
+#define HC_PART		0x0002		/* part is valid */
+
+typedef struct {
+	uint32_t magic, version, entsize, partlen;
+	uint64_t slots, used;
+} hchdr;
+
+typedef struct {
+	uint64_t device, inode;
+	int64_t length, mtime, ctime;
+	uint32_t crc;				/* CRC of the whole file */
+	uint32_t part;				/* CRC of the ends */
+	uint32_t flags;
+	uint32_t seen;				/* day last used */
+} hcent;
+
+/* a table, either the mapped cache file or the new CRCs */
+typedef struct {
+	hcent *ents;
+	uint64_t slots, used;
+	uint32_t partlen;
+} hctable;
+
+static char *hc_path;			/* the cache file, or NULL */
+static void *hc_map;			/* mapping of the cache file */
+static size_t hc_mapsize;
+static hctable hc_old;			/* the cache file, as mapped */
+static hctable hc_new;			/* CRCs found or used in this run */
+static uint32_t hc_today;		/* the day, for seen */
+
+static uint64_t
+hc_hash(uint64_t device, uint64_t inode)
+{
+	uint64_t h = inode * 0x9e3779b97f4a7c15ULL ^ device;
+
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	return h ^ (h >> 29);
+}
+
+/*
+ * hc_slot - the slot of a file in a table, or the free slot for it, or
+ * NULL if the table is full
+ */
+
+static hcent *
+hc_slot(hctable *tp, uint64_t device, uint64_t inode)
+{
+	uint64_t mask = tp->slots - 1, i, n;
+	hcent *ep;
+
+	i = hc_hash(device, inode) & mask;
+	for (n = 0; n < tp->slots; ++n, i = (i + 1) & mask) {
+		ep = tp->ents + i;
+		if (ep->flags == 0 || (ep->device == device && ep->inode == inode))
+			return ep;
+	}
+	return NULL;
+}
+
+/* hc_merge - add what src knows of a file to dst, the same file */
+
+static void
+hc_merge(hcent *dst, const hcent *src)
+{
+	if (dst->flags == 0 || dst->length != src->length
+		|| dst->mtime != src->mtime || dst->ctime != src->ctime
+	) {
+		*dst = *src;
+		return;
+	}
+	if (src->flags & HC_FULL) dst->crc = src->crc;
+	if (src->flags & HC_PART) dst->part = src->part;
+	dst->flags |= src->flags;
+	if (src->seen > dst->seen) dst->seen = src->seen;
+}
+
+/* hc_insert - merge an entry into a table with room for it */
+
+static void
+hc_insert(hctable *tp, const hcent *src, uint32_t partlen)
+{
+	hcent *ep, e = *src;
+
+	if (partlen != tp->partlen) {
+		e.flags &= ~HC_PART;
+		if (e.flags == 0) return;
+	}
+	if ((ep = hc_slot(tp, e.device, e.inode)) == NULL) return;
+	if (ep->flags == 0) ++tp->used;
+	hc_merge(ep, &e);
+}
+
+/* hc_grow - double a table in memory */
+
+static int
+hc_grow(hctable *tp)
+{
+	hctable t;
+	uint64_t i;
+
+	t.slots = tp->slots ? 2 * tp->slots : HC_MINSLOTS;
+	t.used = 0;
+	t.partlen = tp->partlen;
+	if ((t.ents = (hcent *) calloc(t.slots, sizeof(hcent))) == NULL)
+		return -1;
+	for (i = 0; i < tp->slots; ++i) {
+		if (tp->ents[i].flags) hc_insert(&t, tp->ents + i, t.partlen);
+	}
+	free(tp->ents);
+	*tp = t;
+	return 0;
+}
+
+/* hc_add - add an entry to the new CRCs, growing them as needed */
+
+static void
+hc_add(const hcent *src, uint32_t partlen)
+{
+	if (2 * (hc_new.used + 1) > hc_new.slots && hc_grow(&hc_new)) {
+		return;					/* only a cache */
+	}
+	hc_insert(&hc_new, src, partlen);
+}
+
+/*
+ * hc_map_file - map a cache file, 0 if it is mapped, -1 if there is none;
+ * a file that is not a cache is reported unless quiet is set
+ */
+
+static int
+hc_map_file(const char *path, void **mapp, size_t *sizep, hctable *tp, int quiet)
+{
+	struct stat statbuf;
+	hchdr *hp;
+	void *map;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		if (errno != ENOENT) perror(path);
+		return -1;
+	}
+	if (fstat(fd, &statbuf) || statbuf.st_size < HC_HDRSIZE) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(path);
+		return -1;
+	}
+	hp = (hchdr *) map;
+	if (hp->magic != HC_MAGIC || hp->version != HC_VERSION
+		|| hp->entsize != sizeof(hcent) || hp->slots == 0
+		|| (hp->slots & (hp->slots - 1)) != 0 || hp->used >= hp->slots
+		/* by division first, so that a huge count of slots can't wrap around */
+		|| hp->slots > ((uint64_t) statbuf.st_size - HC_HDRSIZE) / sizeof(hcent)
+		|| (uint64_t) statbuf.st_size != HC_HDRSIZE + hp->slots * sizeof(hcent)
+	) {
+		if (!quiet)
+			fprintf(stderr, "%s: not a cache of this version, ignored\n", path);
+		munmap(map, statbuf.st_size);
+		return -1;
+	}
+	madvise(map, statbuf.st_size, MADV_RANDOM);
+	*mapp = map;
+	*sizep = statbuf.st_size;
+	tp->ents = (hcent *) ((char *) map + HC_HDRSIZE);
+	tp->slots = hp->slots;
+	tp->used = hp->used;
+	tp->partlen = hp->partlen;
+	return 0;
+}
+
+/* hcache_open - use a cache file, which need not exist yet */
+
+void
+hcache_open(const char *path, off_t partlen)
+{
+	if ((hc_path = strdup(path)) == NULL) {
+		perror("Out of memory!");
+		exit(1);
+	}
+	hc_new.partlen = partlen;
+	hc_today = (uint32_t) (time(NULL) / 86400);
+	if (hc_map_file(path, &hc_map, &hc_mapsize, &hc_old, 0)) {
+		hc_map = NULL;
+		hc_old.slots = 0;
+	}
+}
+
+/*
+ * hcache_get - get the CRC of a file from the new CRCs or the cache, of
+ * its ends if part is set, 1 if it was there; an entry of the cache
+ * last used before today is copied to the new CRCs, to restamp it
+ */
+
+int
+hcache_get(uint64_t device, uint64_t inode, int64_t length, int64_t mtime,
+	int64_t ctime, int part, uint32_t *crcp)
+{
+	const hcent *ep;
+	hcent e;
+	hctable *tp;
+	int t;
+
+	if (hc_path == NULL) return 0;
+	for (t = 0; t < 2; ++t) {
+		tp = t == 0 ? &hc_new : &hc_old;
+		if (tp->slots == 0 || (part && tp->partlen != hc_new.partlen))
+			continue;
+		ep = hc_slot(tp, device, inode);
+		if (ep == NULL || ep->flags == 0 || ep->length != length
+			|| ep->mtime != mtime || ep->ctime != ctime
+		) {
+			continue;
+		}
+		if (part ? (ep->flags & HC_PART) == 0 : (ep->flags & HC_FULL) == 0)
+			continue;
+		*crcp = part ? ep->part : ep->crc;
+		if (tp == &hc_old && ep->seen != hc_today) {
+			e = *ep;
+			e.seen = hc_today;
+			hc_add(&e, hc_old.partlen);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+/* hcache_put - add the CRC of a file to the cache, of its ends if part is set */
+
+void
+hcache_put(uint64_t device, uint64_t inode, int64_t length, int64_t mtime,
+	int64_t ctime, int part, uint32_t crc)
+{
+	hcent e;
+
+	if (hc_path == NULL) return;
+	memset(&e, 0, sizeof(e));
+	e.device = device;
+	e.inode = inode;
+	e.length = length;
+	e.mtime = mtime;
+	e.ctime = ctime;
+	e.seen = hc_today;
+	if (part) {
+		e.part = crc;
+		e.flags = HC_PART;
+	}
+	else {
+		e.crc = crc;
+		e.flags = HC_FULL;
+	}
+	hc_add(&e, hc_new.partlen);
+}
+
+/* hc_write - write a table as a cache file */
+
+static int
+hc_write(const char *path, hctable *tp)
+{
+	hchdr hdr;
+	FILE *fp;
+	int ok;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = HC_MAGIC;
+	hdr.version = HC_VERSION;
+	hdr.entsize = sizeof(hcent);
+	hdr.partlen = tp->partlen;
+	hdr.slots = tp->slots;
+	hdr.used = tp->used;
+	if ((fp = fopen(path, "w")) == NULL) return -1;
+	ok = fwrite(&hdr, HC_HDRSIZE, 1, fp) == 1
+		&& fwrite(tp->ents, sizeof(hcent), tp->slots, fp) == tp->slots
+		&& fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+	return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+/*
+ * hcache_save - merge the new CRCs into the cache file, dropping the
+ * entries that expired, and stop using it; a cache that can't be saved
+ * is only reported
+ */
+
+void
+hcache_save(void)
+{
+	hctable t;
+	void *map = NULL;
+	size_t mapsize = 0;
+	hctable cur;
+	uint64_t i;
+	char *lockpath, *tmppath;
+	int lockfd = -1;
+	size_t len;
+
+	if (hc_path == NULL) return;
+	if (hc_new.used == 0) goto done;
+
+	len = strlen(hc_path) + 32;
+	lockpath = (char *) malloc(len);
+	tmppath = (char *) malloc(len);
+	if (lockpath == NULL || tmppath == NULL) {
+		free(lockpath);
+		free(tmppath);
+		goto done;
+	}
+	snprintf(lockpath, len, "%s.lock", hc_path);
+	snprintf(tmppath, len, "%s.%ld.tmp", hc_path, (long) getpid());
+
+	/* one run at a time merges into the file as it is now */
+	lockfd = open(lockpath, O_RDWR | O_CREAT, 0666);
+	if (lockfd < 0 || flock(lockfd, LOCK_EX)) {
+		perror(lockpath);
+		goto out;
+	}
+	/* one that is not a cache was reported when opened, and is replaced now */
+	if (hc_map_file(hc_path, &map, &mapsize, &cur, 1)) {
+		map = NULL;
+		cur.slots = cur.used = 0;
+	}
+
+	t.partlen = hc_new.partlen;
+	t.used = 0;
+	for (t.slots = HC_MINSLOTS; t.slots < 2 * (cur.used + hc_new.used); t.slots *= 2)
+		;
+	if ((t.ents = (hcent *) calloc(t.slots, sizeof(hcent))) == NULL) {
+		perror("Can't save the cache");
+		goto out;
+	}
+	for (i = 0; i < cur.slots; ++i) {
+		if (cur.ents[i].flags
+			&& (int64_t) hc_today - cur.ents[i].seen <= HC_EXPIRE
+		) {
+			hc_insert(&t, cur.ents + i, cur.partlen);
+		}
+	}
+	for (i = 0; i < hc_new.slots; ++i) {
+		if (hc_new.ents[i].flags) hc_insert(&t, hc_new.ents + i, hc_new.partlen);
+	}
+	if (hc_write(tmppath, &t) || rename(tmppath, hc_path)) {
+		perror(hc_path);
+		unlink(tmppath);
+	}
+	free(t.ents);
+
+out:
+	if (map != NULL) munmap(map, mapsize);
+	if (lockfd >= 0) close(lockfd);
+	free(lockpath);
+	free(tmppath);
+done:
+	if (hc_map != NULL) munmap(hc_map, hc_mapsize);
+	free(hc_new.ents);
+	free(hc_path);
+	hc_path = NULL;
+}
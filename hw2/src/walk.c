@@ -0,0 +1,459 @@
+/****************************************************************\
+|  walk.c - find the regular files under directories, in parallel
+|----------------------------------------------------------------
+|  Each worker thread has a deque of directories to read. It takes
+|  the newest directory from its own deque, and when that is empty
+|  steals the oldest from another's, so the workers spread over the
+|  tree without contending for one queue. A directory is read with
+|  getdents64 and its entries are stat'ed relative to it with
+|  fstatat, so no path is looked up from the root more than once.
+|  Symbolic links are not followed, as with "find -type f".
+|
+|  The files found by each worker are kept apart, with their paths
+|  packed in a name table of its own and only the parts of their
+|  stat that the list needs. Each worker sorts its files by name
+|  when the walk is done, and the sorted lists are merged as they
+|  are handed over, so the list built from them is the same for any
+|  number of workers.
+\***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "finddup.h"
+
+#define DENTBUF	32768			/* bytes of directory entries read at a time */
+
+/* a regular file found, with the parts of its stat used by the list */
+typedef struct {
+	size_t name;				/* offset of the path in the names of the walker */
+	off_t size;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtim, ctim;
+} walkent;
+
+/* the directories waiting to be read by one worker, and its files */
+typedef struct {
+	pthread_mutex_t lock;
+	char **dirs;				/* deque: thieves take at lo, owner at hi */
+	long lo, hi, maxdirs;
+	walkent *files;				/* regular files found, owner only */
+	long nfiles, maxfiles;
+	char *names;				/* their paths, null-terminated, owner only */
+	size_t namelen, maxnames;
+	long next;					/* the next file to hand over, when merging */
+} walker;
+
+static walker *walkers;
+static int nwalkers;
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static long pending;			/* directories queued or being read */
+static unsigned long pushes;	/* directories ever queued */
+static _Thread_local const char *sortnames;	/* names of the walker being sorted */
+
+#if defined(__linux__) && defined(SYS_getdents64)
+struct dirent64_k {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+#endif
+
+static void
+walk_oom(void)
+{
+	perror("Out of memory!");
+	exit(1);
+}
+
+static void
+walk_ignored(const char *path, int err)
+{
+	fprintf(stderr, "\n  %s - ignored: %s\n", path, strerror(err));
+}
+
+/* walk_push - queue a directory to be read, by worker w */
+
+static void
+walk_push(walker *w, char *path)
+{
+	pthread_mutex_lock(&w->lock);
+	if (w->lo > 0 && w->lo == w->hi) {
+		w->lo = w->hi = 0;
+	}
+	if (w->hi == w->maxdirs) {
+		w->maxdirs = w->maxdirs ? 2 * w->maxdirs : 64;
+		w->dirs = (char **) realloc(w->dirs, w->maxdirs * sizeof(char *));
+		if (w->dirs == NULL) walk_oom();
+	}
+	w->dirs[w->hi++] = path;
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_mutex_lock(&idle_lock);
+	++pending;
+	++pushes;
+	pthread_cond_signal(&idle_cond);
+	pthread_mutex_unlock(&idle_lock);
+}
+
+/* walk_take - the newest directory of w for its owner, or the oldest for a thief */
+
+static char *
+walk_take(walker *w, int owner)
+{
+	char *path = NULL;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->lo < w->hi) {
+		path = owner ? w->dirs[--w->hi] : w->dirs[w->lo++];
+	}
+	pthread_mutex_unlock(&w->lock);
+	return path;
+}
+
+/*
+ * walk_name - add the path of name in dir (or name alone, if dir is NULL)
+ * to the names of worker w, and return its offset there
+ */
+
+static size_t
+walk_name(walker *w, const char *dir, const char *name)
+{
+	size_t dlen = dir ? strlen(dir) : 0, nlen = strlen(name);
+	size_t loc = w->namelen;
+
+	if (loc + dlen + nlen + 2 > w->maxnames) {
+		/* double the table, as addname does */
+		do {
+			w->maxnames = w->maxnames ? 2 * w->maxnames : 16384;
+		} while (loc + dlen + nlen + 2 > w->maxnames);
+		w->names = (char *) realloc(w->names, w->maxnames);
+		if (w->names == NULL) walk_oom();
+	}
+	if (dir) {
+		memcpy(w->names + loc, dir, dlen);
+		if (dir[dlen-1] != '/')		/* only the root "/" ends with one */
+			w->names[loc + dlen++] = '/';
+	}
+	memcpy(w->names + loc + dlen, name, nlen + 1);
+	w->namelen = loc + dlen + nlen + 1;
+	return loc;
+}
+
+/* walk_found - keep a regular file found by worker w, named at name */
+
+static void
+walk_found(walker *w, size_t name, struct stat *sp)
+{
+	walkent *ep;
+
+	if (w->nfiles == w->maxfiles) {
+		w->maxfiles = w->maxfiles ? 2 * w->maxfiles : 256;
+		w->files = (walkent *) realloc(w->files, w->maxfiles * sizeof(walkent));
+		if (w->files == NULL) walk_oom();
+	}
+	ep = &w->files[w->nfiles++];
+	ep->name = name;
+	ep->size = sp->st_size;
+	ep->dev = sp->st_dev;
+	ep->ino = sp->st_ino;
+	ep->mtim = sp->st_mtim;
+	ep->ctim = sp->st_ctim;
+}
+
+/* walk_subdir - queue the directory named at loc in the names of w, and drop the name */
+
+static void
+walk_subdir(walker *w, size_t loc)
+{
+	char *path;
+
+	if ((path = strdup(w->names + loc)) == NULL) walk_oom();
+	w->namelen = loc;
+	walk_push(w, path);
+}
+
+/* walk_entry - handle one entry of a directory open on fd */
+
+static void
+walk_entry(walker *w, int fd, const char *dir, const char *name, int type)
+{
+	struct stat statbuf;
+	size_t loc;
+
+	if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+		return;
+	if (type != DT_DIR && type != DT_REG && type != DT_UNKNOWN)
+		return;
+
+	/* the path goes in the names, and stays there only for a regular file */
+	loc = walk_name(w, dir, name);
+	if (type == DT_DIR) {
+		walk_subdir(w, loc);
+		return;
+	}
+	if (fstatat(fd, name, &statbuf, AT_SYMLINK_NOFOLLOW)) {
+		walk_ignored(w->names + loc, errno);
+		w->namelen = loc;
+	}
+	else if (S_ISDIR(statbuf.st_mode)) {
+		walk_subdir(w, loc);
+	}
+	else if (S_ISREG(statbuf.st_mode)) {
+		walk_found(w, loc, &statbuf);
+	}
+	else {
+		w->namelen = loc;
+	}
+}
+
+/* walk_dir - read a directory, queueing its subdirectories */
+
+static void
+walk_dir(walker *w, char *dir)
+{
+	int fd;
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		walk_ignored(dir, errno);
+		return;
+	}
+#if defined(__linux__) && defined(SYS_getdents64)
+	{
+		char buf[DENTBUF];
+		struct dirent64_k *dp;
+		long got, off;
+
+		while ((got = syscall(SYS_getdents64, fd, buf, DENTBUF)) > 0) {
+			for (off = 0; off < got; off += dp->d_reclen) {
+				dp = (struct dirent64_k *) (buf + off);
+				walk_entry(w, fd, dir, dp->d_name, dp->d_type);
+			}
+		}
+		if (got < 0) walk_ignored(dir, errno);
+		close(fd);
+	}
+#else
+	{
+		DIR *dirp;
+		struct dirent *dp;
+
+		if ((dirp = fdopendir(fd)) == NULL) {
+			walk_ignored(dir, errno);
+			close(fd);
+			return;
+		}
+		while ((dp = readdir(dirp)) != NULL) {
+			walk_entry(w, fd, dir, dp->d_name, dp->d_type);
+		}
+		closedir(dirp);
+	}
+#endif
+}
+
+static int
+walk_comp(const void *p1, const void *p2)
+{
+	return strcmp(sortnames + ((const walkent *) p1)->name,
+		sortnames + ((const walkent *) p2)->name);
+}
+
+/* walk_sort - sort the files of worker w by name */
+
+static void
+walk_sort(walker *w)
+{
+	sortnames = w->names;
+	qsort(w->files, w->nfiles, sizeof(walkent), walk_comp);
+}
+
+/* walk_worker - read directories until none are left anywhere */
+
+static void *
+walk_worker(void *arg)
+{
+	walker *w = arg;
+	unsigned long seen;
+	char *dir;
+	int i, me = w - walkers;
+
+	for (;;) {
+		pthread_mutex_lock(&idle_lock);
+		seen = pushes;
+		pthread_mutex_unlock(&idle_lock);
+
+		dir = walk_take(w, 1);
+		for (i = 1; dir == NULL && i < nwalkers; ++i) {
+			dir = walk_take(&walkers[(me + i) % nwalkers], 0);
+		}
+		if (dir != NULL) {
+			walk_dir(w, dir);
+			free(dir);
+			pthread_mutex_lock(&idle_lock);
+			if (--pending == 0) pthread_cond_broadcast(&idle_cond);
+			pthread_mutex_unlock(&idle_lock);
+			continue;
+		}
+
+		/* nothing to take: wait for a push, or for the end */
+		pthread_mutex_lock(&idle_lock);
+		while (pending > 0 && pushes == seen) {
+			pthread_cond_wait(&idle_cond, &idle_lock);
+		}
+		if (pending == 0) {
+			pthread_mutex_unlock(&idle_lock);
+			walk_sort(w);
+			return NULL;
+		}
+		pthread_mutex_unlock(&idle_lock);
+	}
+}
+
+/* walk_before - whether the next file of worker a comes before that of worker b */
+
+static int
+walk_before(int a, int b)
+{
+	walker *wa = &walkers[a], *wb = &walkers[b];
+	int cmp = strcmp(wa->names + wa->files[wa->next].name,
+		wb->names + wb->files[wb->next].name);
+
+	return cmp < 0 || (cmp == 0 && a < b);
+}
+
+/* walk_sift - move the worker at k of a heap of n down to its place */
+
+static void
+walk_sift(int *heap, int n, int k)
+{
+	int c, t;
+
+	while ((c = 2 * k + 1) < n) {
+		if (c + 1 < n && walk_before(heap[c+1], heap[c])) ++c;
+		if (!walk_before(heap[c], heap[k])) break;
+		t = heap[k];
+		heap[k] = heap[c];
+		heap[c] = t;
+		k = c;
+	}
+}
+
+/*
+ * walk_dirs - find the regular files under the roots on jobs threads, and
+ * pass each with its stat to found, in the order of their names; only the
+ * size, device, inode, and times of modification and change of the stat are set
+ */
+
+int
+walk_dirs(char **roots, int nroots, int jobs, void (*found)(char *, struct stat *))
+{
+	pthread_t *tids;
+	struct stat statbuf;
+	walker *w;
+	walkent *ep;
+	int *heap;
+	int i, n, started, nstarted;
+	size_t len;
+	char *root;
+
+	nwalkers = jobs;
+	walkers = (walker *) calloc(jobs, sizeof(walker));
+	tids = (pthread_t *) malloc(jobs * sizeof(pthread_t));
+	if (walkers == NULL || tids == NULL) walk_oom();
+	for (i = 0; i < jobs; ++i) {
+		pthread_mutex_init(&walkers[i].lock, NULL);
+	}
+
+	/* the roots, spread over the workers */
+	for (i = 0; i < nroots; ++i) {
+		len = strlen(roots[i]);
+		while (len > 1 && roots[i][len-1] == '/') --len;
+		if ((root = strndup(roots[i], len)) == NULL) walk_oom();
+		if (stat(root, &statbuf)) {
+			walk_ignored(root, errno);
+			free(root);
+		}
+		else if (S_ISDIR(statbuf.st_mode)) {
+			walk_push(&walkers[i % jobs], root);
+		}
+		else {
+			if (S_ISREG(statbuf.st_mode)) {
+				w = &walkers[i % jobs];
+				walk_found(w, walk_name(w, NULL, root), &statbuf);
+			}
+			free(root);
+		}
+	}
+
+	for (started = 1; started < jobs; ++started) {
+		if (pthread_create(&tids[started], NULL, walk_worker, &walkers[started])) break;
+	}
+	nstarted = started;
+	walk_worker(&walkers[0]);
+	while (--started > 0) {
+		pthread_join(tids[started], NULL);
+	}
+	/* a worker that did not start may still hold a root file */
+	for (i = nstarted; i < jobs; ++i) {
+		walk_sort(&walkers[i]);
+	}
+
+	/* hand the files over in order, merging the lists of the workers */
+	if ((heap = (int *) malloc(jobs * sizeof(int))) == NULL) walk_oom();
+	for (n = 0, i = 0; i < jobs; ++i) {
+		free(walkers[i].dirs);
+		pthread_mutex_destroy(&walkers[i].lock);
+		if (walkers[i].nfiles > 0) {
+			heap[n++] = i;
+		}
+	}
+	for (i = n / 2; i-- > 0; ) {
+		walk_sift(heap, n, i);
+	}
+	memset(&statbuf, 0, sizeof(statbuf));
+	while (n > 0) {
+		w = &walkers[heap[0]];
+		ep = &w->files[w->next++];
+		statbuf.st_size = ep->size;
+		statbuf.st_dev = ep->dev;
+		statbuf.st_ino = ep->ino;
+		statbuf.st_mtim = ep->mtim;
+		statbuf.st_ctim = ep->ctim;
+		found(w->names + ep->name, &statbuf);
+		if (w->next == w->nfiles) {
+			/* this list is done, so its memory can go before the rest are */
+			free(w->files);
+			free(w->names);
+			w->files = NULL;
+			w->names = NULL;
+			heap[0] = heap[--n];
+		}
+		if (n > 0) {
+			walk_sift(heap, n, 0);
+		}
+	}
+	for (i = 0; i < jobs; ++i) {
+		free(walkers[i].files);		/* those that found no files */
+		free(walkers[i].names);
+	}
+	free(heap);
+	free(walkers);
+	free(tids);
+	return 0;
+}
@@ -1,7 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <criterion/criterion.h>
 #include <string.h>
+#include "finddup.h"
 
 #define TEST_TIMEOUT 15
 
@@ -30,6 +33,24 @@ int setup_test(char *name) {
     return system(cmd);
 }
 
+/*
+ * Sets up a copy of the test tree, with links of its own, for a test that
+ * walks or changes it, so that the other tests cannot change it between runs.
+ * The copy is TEST_OUTPUT_DIR/<name>_tree, and the list of its files, in the
+ * order of their names, is TEST_OUTPUT_DIR/<name>_names.
+ */
+int setup_tree(char *name) {
+    char cmd[1000];
+    sprintf(cmd, "rm -fr %s/%s_tree %s/%s.cache*; mkdir -p %s; cp -a tests/rsrc/test_tree %s/%s_tree; "
+		 "ln -f %s/%s_tree/file1 %s/%s_tree/file1.lnk; ln -f %s/%s_tree/file2 %s/%s_tree/file2.lnk; "
+		 "find %s/%s_tree -type f | LC_ALL=C sort > %s/%s_names",
+	    TEST_OUTPUT_DIR, name, TEST_OUTPUT_DIR, name, TEST_OUTPUT_DIR, TEST_OUTPUT_DIR, name,
+	    TEST_OUTPUT_DIR, name, TEST_OUTPUT_DIR, name, TEST_OUTPUT_DIR, name, TEST_OUTPUT_DIR, name,
+	    TEST_OUTPUT_DIR, name, TEST_OUTPUT_DIR, name);
+    fprintf(stderr, "setup(%s)\n", cmd);
+    return system(cmd);
+}
+
 /*
  * Run the program as a "black box" using system().
  * A shell command is constructed and run that first performs test setup,
@@ -93,6 +114,78 @@ void assert_errfile_matches(char *name, char *filter) {
     cr_assert_eq(err, 0, "The output was not what was expected (diff exited with status %d).\n", WEXITSTATUS(err));
 }
 
+/*
+ * Compare the standard output of the program in a test that has been run with
+ * that in another, instead of with reference output.
+ */
+void assert_outfile_matches_run(char *name, char *other) {
+    char cmd[500];
+    sprintf(cmd, "diff %s/%s.out %s/%s.out", TEST_OUTPUT_DIR, name, TEST_OUTPUT_DIR, other);
+    int err = system(cmd);
+    cr_assert_eq(err, 0, "The output of %s differs from that of %s (diff exited with status %d).\n",
+		 name, other, WEXITSTATUS(err));
+}
+
+/*
+ * Compare the standard error output of the program in a test that has been run
+ * with that in another, instead of with reference output.
+ */
+void assert_errfile_matches_run(char *name, char *other) {
+    char cmd[500];
+    sprintf(cmd, "diff %s/%s.err %s/%s.err", TEST_OUTPUT_DIR, name, TEST_OUTPUT_DIR, other);
+    int err = system(cmd);
+    cr_assert_eq(err, 0, "The error output of %s differs from that of %s (diff exited with status %d).\n",
+		 name, other, WEXITSTATUS(err));
+}
+
+/*
+ * Check that the program reported a cache file as ignored, just once, in a test that has been run.
+ */
+void assert_cache_ignored(char *name, char *cache) {
+    char cmd[500];
+    sprintf(cmd, "test \"$(grep -o '%s: not a cache of this version, ignored' %s/%s.err | wc -l)\" -eq 1",
+	    cache, TEST_OUTPUT_DIR, name);
+    int err = system(cmd);
+    cr_assert_eq(err, 0, "The cache %s was not reported once as ignored -- see %s/%s.err.\n",
+		 cache, TEST_OUTPUT_DIR, name);
+}
+
+/*
+ * The count of entries in a cache file, from its header, or -1 if it can't
+ * be read.
+ */
+long cache_entries(char *cache) {
+    unsigned long long used;
+    FILE *f = fopen(cache, "r");
+    if(f == NULL) return -1;
+    int ok = fseek(f, 24, SEEK_SET) == 0 && fread(&used, sizeof(used), 1, f) == 1;
+    fclose(f);
+    return ok ? (long) used : -1;
+}
+
+/*
+ * Stamps every entry of a cache file as last used on the given day, as
+ * if the runs that used them were that long ago.
+ */
+void age_cache(char *cache, unsigned int day) {
+    unsigned int hdr[4], ent[64];
+    unsigned long long slots;
+    FILE *f = fopen(cache, "r+");
+    cr_assert_not_null(f, "The cache %s can't be opened.\n", cache);
+    cr_assert(fread(hdr, sizeof(hdr), 1, f) == 1 && fread(&slots, sizeof(slots), 1, f) == 1
+	      && hdr[2] <= sizeof(ent), "The cache %s can't be read.\n", cache);
+    for(unsigned long long i = 0; i < slots; i++) {
+	long off = 32 + i * hdr[2];
+	fseek(f, off, SEEK_SET);
+	cr_assert(fread(ent, hdr[2], 1, f) == 1, "The cache %s is short.\n", cache);
+	if(ent[hdr[2] / 4 - 2] == 0) continue;	/* free */
+	ent[hdr[2] / 4 - 1] = day;
+	fseek(f, off, SEEK_SET);
+	fwrite(ent, hdr[2], 1, f);
+    }
+    fclose(f);
+}
+
 void assert_no_valgrind_errors(int status) {
     cr_assert_neq(WEXITSTATUS(status), 37, "Valgrind reported errors -- see %s.err", test_log_outfile);
 }
@@ -150,6 +243,290 @@ Test(base_suite, larger_test) {
     assert_errfile_matches(name, NULL);
 }
 
+/*
+ * Tests the full compare of files whose CRCs agree: two identical files of
+ * high bytes, with runs of 0xff, must be reported as duplicates, and two files
+ * that differ only within their last block must not.  The latter are made to
+ * have the same ends and the same CRC, so that only the compare tells them apart.
+ */
+Test(base_suite, compare_test) {
+    char *name = "compare_test";
+    sprintf(program_options, "tests/rsrc/compare_test_names");
+    int err = run_using_system(name, "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches(name, NULL);
+    assert_errfile_matches(name, NULL);
+}
+
+/*
+ * Tests files over 4 GiB, whose lengths don't fit in 32 bits: two sparse files
+ * of 2^32 + 5 bytes, which differ in their last byte, must be told apart from
+ * each other, and from two duplicate files of 5 bytes, the same as the last 5
+ * bytes of one of them.  That the ends of the large files differ lets their
+ * end CRCs, rather than a read of all of them, tell them apart.
+ */
+Test(base_suite, large_files_test) {
+    char *name = "large_files_test";
+    system("d=" TEST_OUTPUT_DIR "/large_files_test_tree; rm -fr $d; mkdir -p $d; "
+	   "truncate -s $((4294967296+5)) $d/big1 $d/big2; "
+	   "printf a | dd of=$d/big1 bs=1 seek=4294967300 conv=notrunc 2> /dev/null; "
+	   "printf b | dd of=$d/big2 bs=1 seek=4294967300 conv=notrunc 2> /dev/null; "
+	   "printf '\\000\\000\\000\\000a' > $d/small1; cp $d/small1 $d/small2");
+    sprintf(program_options, "tests/rsrc/large_files_test_names");
+    int err = run_using_system(name, "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches(name, NULL);
+    assert_errfile_matches(name, NULL);
+    sprintf(program_options, "-j 4 tests/rsrc/large_files_test_names");
+    err = run_using_system("jobs_large_files_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("jobs_large_files_test", name);
+    assert_errfile_matches_run("jobs_large_files_test", name);
+}
+
+/*
+ * Checks that the table-driven and the fast CRC32 engines give the value of
+ * rc_crc32, the reference, over buffers of every length up to a few hundred
+ * bytes at every alignment, and when chained over a buffer in pieces, so that
+ * the tails and the pieces too short to be folded are covered.
+ */
+#define CRC_CHECK_LEN 300
+#define CRC_CHAIN_SIZE (1 << 20)
+
+Test(base_suite, crc32_test) {
+    struct { char *name; uint32_t (*crc)(uint32_t, const char *, size_t); } engines[] = {
+	{ "crc32_table8", crc32_table8 },
+	{ "crc32_fast", crc32_fast },
+    };
+    char *buf = malloc(CRC_CHAIN_SIZE);
+    cr_assert_not_null(buf, "Can't allocate the buffer.\n");
+    srand(1);
+    for(size_t i = 0; i < CRC_CHAIN_SIZE; i++)
+	buf[i] = rand();
+    for(int e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+	for(size_t off = 0; off < 16; off++) {
+	    for(size_t len = 0; len <= CRC_CHECK_LEN; len++) {
+		uint32_t want = rc_crc32(0x12345678, buf + off, len);
+		uint32_t got = engines[e].crc(0x12345678, buf + off, len);
+		cr_assert_eq(got, want, "%s gave %08x, not %08x, at offset %zu length %zu.\n",
+			     engines[e].name, got, want, off, len);
+	    }
+	}
+	uint32_t want = rc_crc32(0, buf, CRC_CHAIN_SIZE);
+	for(size_t cut = 1; cut < CRC_CHAIN_SIZE; cut = cut * 3 + 7) {
+	    uint32_t got = engines[e].crc(engines[e].crc(0, buf, cut), buf + cut, CRC_CHAIN_SIZE - cut);
+	    cr_assert_eq(got, want, "%s gave %08x, not %08x, chained at %zu.\n",
+			 engines[e].name, got, want, cut);
+	}
+    }
+    free(buf);
+}
+
+/*
+ * The tests that follow rerun the tests above with the CRCs computed on a pool
+ * of four worker threads.  The output must be the same as with none, so the
+ * reference output of each is a copy of that of the corresponding test above.
+ */
+Test(base_suite, jobs_quick_test) {
+    char *name = "jobs_quick_test";
+    sprintf(program_options, "-j 4 tests/rsrc/quick_test_names");
+    int err = run_using_system(name, "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches(name, NULL);
+    assert_errfile_matches(name, NULL);
+}
+
+Test(base_suite, jobs_hard_links_test) {
+    char *name = "jobs_hard_links_test";
+    system("rm -f tests/rsrc/test_tree/file1.lnk tests/rsrc/test_tree/file2.lnk; "
+           "ln tests/rsrc/test_tree/file1 tests/rsrc/test_tree/file1.lnk; "
+           "ln tests/rsrc/test_tree/file2 tests/rsrc/test_tree/file2.lnk");
+    sprintf(program_options, "-j 4 tests/rsrc/hard_links_test_names");
+    int err = run_using_system(name, "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches(name, NULL);
+    assert_errfile_matches(name, NULL);
+}
+
+Test(base_suite, jobs_binary_test) {
+    char *name = "jobs_binary_test";
+    sprintf(program_options, "-j 4 tests/rsrc/binary_test_names");
+    int err = run_using_system(name, "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches(name, NULL);
+    assert_errfile_matches(name, NULL);
+}
+
+Test(base_suite, jobs_larger_test) {
+    char *name = "jobs_larger_test";
+    sprintf(program_options, "-j 4 tests/rsrc/larger_test_names");
+    int err = run_using_system(name, "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches(name, NULL);
+    assert_errfile_matches(name, NULL);
+}
+
+/*
+ * Tests the walk of a directory with -r, serially and on eight threads,
+ * against the list of the files under it that "find" gives, in the order
+ * of their names.  Then the walk is of files given in the reverse order of
+ * their names, which go to different threads, so that the lists of the
+ * threads must be merged for the links to be listed in order.
+ */
+Test(base_suite, walk_test) {
+    char *tree = TEST_OUTPUT_DIR "/walk_test_tree";
+    setup_tree("walk_test");
+    sprintf(program_options, "%s/walk_test_names", TEST_OUTPUT_DIR);
+    int err = run_using_system("walk_list_test", "", "");
+    assert_normal_exit(err);
+    sprintf(program_options, "-r %s", tree);
+    err = run_using_system("walk_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("walk_test", "walk_list_test");
+    assert_errfile_matches_run("walk_test", "walk_list_test");
+    sprintf(program_options, "-j 8 -r %s", tree);
+    err = run_using_system("walk_jobs_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("walk_jobs_test", "walk_list_test");
+    assert_errfile_matches_run("walk_jobs_test", "walk_list_test");
+    system("printf '" TEST_OUTPUT_DIR "/walk_test_tree/%s\\n' file1 file1.lnk file2 file2.lnk "
+	   "> " TEST_OUTPUT_DIR "/walk_roots_names");
+    sprintf(program_options, "%s/walk_roots_names", TEST_OUTPUT_DIR);
+    err = run_using_system("walk_roots_list_test", "", "");
+    assert_normal_exit(err);
+    sprintf(program_options, "-j 8 -r %s/file2.lnk %s/file2 %s/file1.lnk %s/file1", tree, tree, tree, tree);
+    err = run_using_system("walk_roots_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("walk_roots_test", "walk_roots_list_test");
+    assert_errfile_matches_run("walk_roots_test", "walk_roots_list_test");
+}
+
+/*
+ * Tests a run with a cache of the CRCs that does not exist yet, and then a
+ * run that uses the cache the first one saved: both must give the output of
+ * a run without a cache.
+ */
+Test(base_suite, cache_test) {
+    char *names = TEST_OUTPUT_DIR "/cache_test_names";
+    char *cache = TEST_OUTPUT_DIR "/cache_test.cache";
+    setup_tree("cache_test");
+    sprintf(program_options, "%s", names);
+    int err = run_using_system("cache_plain_test", "", "");
+    assert_normal_exit(err);
+    sprintf(program_options, "-c %s %s", cache, names);
+    err = run_using_system("cache_cold_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("cache_cold_test", "cache_plain_test");
+    assert_errfile_matches_run("cache_cold_test", "cache_plain_test");
+    cr_assert_eq(access(cache, R_OK), 0, "The cache %s was not saved.\n", cache);
+    err = run_using_system("cache_warm_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("cache_warm_test", "cache_plain_test");
+    assert_errfile_matches_run("cache_warm_test", "cache_plain_test");
+}
+
+/*
+ * Tests that a file changed since its CRC was cached is hashed again.
+ * Two files of the same length differ when they are cached; then one is
+ * made a copy of the other, with a time of modification of its own, and
+ * they must be found to be duplicates, which the CRC in the cache would hide.
+ */
+Test(base_suite, cache_expire_test) {
+    char *names = TEST_OUTPUT_DIR "/cache_expire_test_names";
+    char *some = TEST_OUTPUT_DIR "/cache_expire_test_some";
+    char *cache = TEST_OUTPUT_DIR "/cache_expire_test.cache";
+    setup_tree("cache_expire_test");
+    system("grep file1 " TEST_OUTPUT_DIR "/cache_expire_test_names > " TEST_OUTPUT_DIR "/cache_expire_test_some");
+    sprintf(program_options, "%s", names);
+    int err = run_using_system("cache_expire_plain_test", "", "");
+    assert_normal_exit(err);
+    sprintf(program_options, "-c %s %s", cache, names);
+    err = run_using_system("cache_expire_cold_test", "", "");
+    assert_normal_exit(err);
+    long all = cache_entries(cache);
+    cr_assert_gt(all, 0, "The cache %s was not saved.\n", cache);
+    /* entries used recently are kept though not used */
+    sprintf(program_options, "-c %s %s", cache, some);
+    err = run_using_system("cache_expire_some_test", "", "");
+    assert_normal_exit(err);
+    cr_assert_eq(cache_entries(cache), all, "Entries of the cache %s were dropped early.\n", cache);
+    /* and entries unused for long are dropped, but for those used now */
+    age_cache(cache, 1);
+    err = run_using_system("cache_expire_old_test", "", "");
+    assert_normal_exit(err);
+    long some_entries = cache_entries(cache);
+    cr_assert(some_entries > 0 && some_entries < all,
+	      "The cache %s has %ld of %ld entries, not just those used.\n", cache, some_entries, all);
+    sprintf(program_options, "-c %s %s", cache, names);
+    err = run_using_system("cache_expire_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("cache_expire_test", "cache_expire_plain_test");
+    assert_errfile_matches_run("cache_expire_test", "cache_expire_plain_test");
+    cr_assert_eq(cache_entries(cache), all, "The cache %s was not refilled.\n", cache);
+}
+
+Test(base_suite, cache_modified_test) {
+    char *names = TEST_OUTPUT_DIR "/cache_modified_test_names";
+    char *cache = TEST_OUTPUT_DIR "/cache_modified_test.cache";
+    setup_tree("cache_modified_test");
+    sprintf(program_options, "-c %s %s", cache, names);
+    int err = run_using_system("cache_modified_cold_test", "", "");
+    assert_normal_exit(err);
+    system("cp " TEST_OUTPUT_DIR "/cache_modified_test_tree/binary1 " TEST_OUTPUT_DIR "/cache_modified_test_tree/binary2; "
+	   "touch -d 2001-01-01 " TEST_OUTPUT_DIR "/cache_modified_test_tree/binary2");
+    sprintf(program_options, "%s", names);
+    err = run_using_system("cache_modified_plain_test", "", "");
+    assert_normal_exit(err);
+    sprintf(program_options, "-c %s %s", cache, names);
+    err = run_using_system("cache_modified_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("cache_modified_test", "cache_modified_plain_test");
+    assert_errfile_matches_run("cache_modified_test", "cache_modified_plain_test");
+}
+
+/*
+ * Tests that a cache with the wrong magic number, or of another version, is
+ * reported and ignored, and then replaced by one that can be used.
+ */
+Test(base_suite, cache_version_test) {
+    char *names = TEST_OUTPUT_DIR "/cache_version_test_names";
+    char *magic = TEST_OUTPUT_DIR "/cache_version_test.cache.magic";
+    char *version = TEST_OUTPUT_DIR "/cache_version_test.cache.version";
+    char *huge = TEST_OUTPUT_DIR "/cache_version_test.cache.huge";
+    setup_tree("cache_version_test");
+    sprintf(program_options, "%s", names);
+    int err = run_using_system("cache_version_plain_test", "", "");
+    assert_normal_exit(err);
+    sprintf(program_options, "-c %s %s", magic, names);
+    err = run_using_system("cache_version_cold_test", "", "");
+    assert_normal_exit(err);
+    /* a count of slots of 2^61 in a file of just a header, whose size would wrap around */
+    system("cp " TEST_OUTPUT_DIR "/cache_version_test.cache.magic " TEST_OUTPUT_DIR "/cache_version_test.cache.huge; "
+	   "truncate -s 32 " TEST_OUTPUT_DIR "/cache_version_test.cache.huge; "
+	   "printf '\\000\\000\\000\\000\\000\\000\\000\\040' | dd of=" TEST_OUTPUT_DIR "/cache_version_test.cache.huge bs=1 seek=16 conv=notrunc 2> /dev/null");
+    system("cp " TEST_OUTPUT_DIR "/cache_version_test.cache.magic " TEST_OUTPUT_DIR "/cache_version_test.cache.version; "
+	   "printf 'XXXX' | dd of=" TEST_OUTPUT_DIR "/cache_version_test.cache.magic bs=1 conv=notrunc 2> /dev/null; "
+	   "printf '\\002' | dd of=" TEST_OUTPUT_DIR "/cache_version_test.cache.version bs=1 seek=4 conv=notrunc 2> /dev/null");
+    err = run_using_system("cache_magic_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("cache_magic_test", "cache_version_plain_test");
+    assert_cache_ignored("cache_magic_test", magic);
+    sprintf(program_options, "-c %s %s", version, names);
+    err = run_using_system("cache_version_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("cache_version_test", "cache_version_plain_test");
+    assert_cache_ignored("cache_version_test", version);
+    err = run_using_system("cache_replaced_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("cache_replaced_test", "cache_version_plain_test");
+    assert_errfile_matches_run("cache_replaced_test", "cache_version_plain_test");
+    sprintf(program_options, "-c %s %s", huge, names);
+    err = run_using_system("cache_huge_test", "", "");
+    assert_normal_exit(err);
+    assert_outfile_matches_run("cache_huge_test", "cache_version_plain_test");
+    assert_cache_ignored("cache_huge_test", huge);
+}
+
 /*
  * This test runs valgrind to check for the use of uninitialized variables.
  */
@@ -0,0 +1,48 @@
+/****************************************************************\
+|  crc32_tables.c - write the slicing-by-8 tables of crc32fast.c
+|----------------------------------------------------------------
+|  Run by make to generate build/crc32_tables.h, so that the
+|  tables are constant data of the program rather than being
+|  built at run time. Entry i of table k is the CRC register
+|  after the byte i followed by k zero bytes, from a zero start.
+\***************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define POLY	0xedb88320		/* reflected CRC-32 polynomial */
+
+int
+main(void)
+{
+	uint32_t table[8][256];
+	uint32_t rem;
+	int i, j, k;
+
+	for (i = 0; i < 256; i++) {
+		rem = i;
+		for (j = 0; j < 8; j++) {
+			rem = (rem >> 1) ^ (rem & 1 ? POLY : 0);
+		}
+		table[0][i] = rem;
+	}
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++) {
+			rem = table[k-1][i];
+			table[k][i] = (rem >> 8) ^ table[0][rem & 0xff];
+		}
+	}
+
+	printf("/* generated by tools/crc32_tables.c - do not edit */\n\n");
+	printf("static const uint32_t crc32_tables[8][256] = {\n");
+	for (k = 0; k < 8; k++) {
+		printf("\t{");
+		for (i = 0; i < 256; i++) {
+			printf("%s0x%08lx%s", i % 6 ? " " : "\n\t\t",
+				(unsigned long) table[k][i], i < 255 ? "," : "");
+		}
+		printf("\n\t}%s\n", k < 7 ? "," : "");
+	}
+	printf("};\n");
+	return 0;
+}